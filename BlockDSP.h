@@ -0,0 +1,547 @@
+#pragma once
+
+// Block rendered versions of the vessl units WaveShaperDSP used to patch together.
+// Instead of the whole graph being ticked once per sample, each unit renders an entire
+// sub-block into a buffer provided by the caller before the next unit in the chain runs,
+// which keeps every inner loop short and working on data that is already in cache.
+
+#include "ShaperKernel.h"
+
+#include <cmath>
+#include <cstdint>
+
+namespace block
+{
+  // The wiring between units never changes, so rather than each unit writing a buffer for the next
+  // one to read, the simple per-frame steps that follow a unit are handed to its render as a stage
+  // and applied to every frame before it is stored. A stage is any value with `T operator()(T x, int s)`
+  // that returns what frame s becomes, and pipe joins two of them into one, so a chain of them is a
+  // single type the compiler inlines into the unit's loop.
+
+  // leaves every frame as it is
+  struct passThrough
+  {
+    template<typename T>
+    T operator()(T x, int) const { return x; }
+  };
+
+  template<typename T>
+  struct multiplyBy
+  {
+    const T* gain;
+    T operator()(T x, int s) const { return x * gain[s]; }
+  };
+
+  template<typename T>
+  struct offsetBy
+  {
+    const T* offset;
+    T operator()(T x, int s) const { return x + offset[s]; }
+  };
+
+  // passes frames through while keeping a copy of them, for reading what a chain had made of them partway along
+  template<typename T>
+  struct copyTo
+  {
+    T* out;
+    T operator()(T x, int s) const { out[s] = x; return x; }
+  };
+
+  // passes frames through while keeping track of the largest step from one to the next
+  template<typename T>
+  struct peakStep
+  {
+    T previous;
+    T peak;
+    T operator()(T x, int)
+    {
+      const T step = std::abs(x - previous);
+      peak = step > peak ? step : peak;
+      previous = x;
+      return x;
+    }
+  };
+
+  template<typename A, typename B>
+  struct piped
+  {
+    A first;
+    B second;
+    template<typename T>
+    T operator()(T x, int s) { return second(first(x, s), s); }
+  };
+
+  // first and then second. stages are held by value, wrap one in std::ref to read its state afterwards.
+  template<typename A, typename B>
+  piped<A, B> pipe(A first, B second) { return piped<A, B>{ first, second }; }
+
+  struct noiseTint
+  {
+    // same order as Minim::Noise::Tint so the two can be cast between
+    enum type
+    {
+      white,
+      pink,
+      red
+    };
+  };
+
+  struct smoothing
+  {
+    enum type
+    {
+      // constant steps, which is what Minim::Line does
+      linear,
+      // constant ratios, for values heard on a log scale. used between values that are both on the same side of zero.
+      exponential,
+      // a one-pole lowpass that gets 60dB of the way there in the duration
+      onePole
+    };
+  };
+
+  // moves a parameter to a new value over a number of seconds, one block at a time.
+  // every curve reaches the target after exactly as many frames as the duration lasts, and once it
+  // has settled render only fills the buffer, which a caller can skip altogether by checking isSettled.
+  template<typename T>
+  class smoother
+  {
+  public:
+    smoother(T value = 0, smoothing::type curve = smoothing::linear)
+      : curve(curve), mActiveCurve(curve), mValue(value), mTarget(value), mDuration(0), mStep(0), mRemaining(0), mStart(false)
+    {
+    }
+
+    // starts moving from wherever the value currently is, the steps are worked out by the next render
+    void rampTo(T target, T duration)
+    {
+      mTarget = target;
+      mDuration = duration;
+      mStart = true;
+    }
+
+    bool isSettled() const { return !mStart && mRemaining == 0; }
+    T getValue() const { return mValue; }
+    T getTarget() const { return mTarget; }
+
+    void render(T* out, const int nFrames, const T dt)
+    {
+      if (mStart)
+      {
+        start(dt);
+      }
+
+      int s = 0;
+      if (mRemaining > 0)
+      {
+        const int frames = mRemaining < nFrames ? mRemaining : nFrames;
+        switch (mActiveCurve)
+        {
+          case smoothing::linear:
+            // each frame is worked out from the start of the block, so the loop vectorizes
+            for (; s < frames; ++s)
+            {
+              out[s] = mValue + mStep * s;
+            }
+            mValue += mStep * frames;
+            break;
+
+          case smoothing::exponential:
+            mValue = geometric(out, frames, 0, mValue);
+            break;
+
+          case smoothing::onePole:
+            mValue = geometric(out, frames, mTarget, mValue - mTarget);
+            break;
+        }
+        s = frames;
+
+        mRemaining -= frames;
+        if (mRemaining == 0)
+        {
+          mValue = mTarget;
+        }
+      }
+
+      for (; s < nFrames; ++s)
+      {
+        out[s] = mValue;
+      }
+    }
+
+    // moves on by nFrames exactly as render would, without writing them anywhere
+    void skip(const int nFrames, const T dt)
+    {
+      if (mStart)
+      {
+        start(dt);
+      }
+
+      if (mRemaining == 0)
+      {
+        return;
+      }
+
+      const int frames = mRemaining < nFrames ? mRemaining : nFrames;
+      switch (mActiveCurve)
+      {
+        case smoothing::linear:
+          mValue += mStep * frames;
+          break;
+
+        case smoothing::exponential:
+          mValue *= std::pow(mStep, (T)frames);
+          break;
+
+        case smoothing::onePole:
+          mValue = mTarget + (mValue - mTarget) * std::pow(mStep, (T)frames);
+          break;
+      }
+
+      mRemaining -= frames;
+      if (mRemaining == 0)
+      {
+        mValue = mTarget;
+      }
+    }
+
+    smoothing::type curve;
+
+  private:
+    void start(const T dt)
+    {
+      mStart = false;
+      mRemaining = dt > 0 ? (int)std::ceil(mDuration / dt) : 0;
+      mActiveCurve = curve;
+      if (mActiveCurve == smoothing::exponential && !(mValue * mTarget > 0))
+      {
+        mActiveCurve = smoothing::linear;
+      }
+
+      if (mRemaining <= 0)
+      {
+        mRemaining = 0;
+        mValue = mTarget;
+        return;
+      }
+
+      switch (mActiveCurve)
+      {
+        case smoothing::linear:
+          mStep = (mTarget - mValue) / mRemaining;
+          break;
+
+        case smoothing::exponential:
+          mStep = std::pow(mTarget / mValue, (T)1 / mRemaining);
+          break;
+
+        case smoothing::onePole:
+          // ln(0.001)
+          mStep = std::exp((T)-6.907755278982137 / mRemaining);
+          break;
+      }
+    }
+
+    // writes offset + delta * mStep^s, four frames at a time from powers of mStep so that
+    // there is no dependency from one frame to the next inside of a group. returns the value after the last frame.
+    T geometric(T* out, const int nFrames, const T offset, T delta)
+    {
+      const T r2 = mStep * mStep;
+      const T powers[4] = { 1, mStep, r2, r2 * mStep };
+      const T r4 = r2 * r2;
+      int s = 0;
+      for (; s + 4 <= nFrames; s += 4)
+      {
+        for (int k = 0; k < 4; ++k)
+        {
+          out[s + k] = offset + delta * powers[k];
+        }
+        delta *= r4;
+      }
+      for (; s < nFrames; ++s)
+      {
+        out[s] = offset + delta;
+        delta *= mStep;
+      }
+      return offset + delta;
+    }
+
+    smoothing::type mActiveCurve;
+    T mValue, mTarget, mDuration;
+    // amount added for linear, otherwise the ratio from one frame to the next
+    T mStep;
+    int mRemaining;
+    bool mStart;
+  };
+
+  // white noise in [-1, 1) from four xorshift32 generators running side by side,
+  // which are stepped together with SSE2 when it is available.
+  class whiteNoise
+  {
+  public:
+    enum { lanes = 4 };
+
+    whiteNoise(uint32_t seed = 0x9E3779B9u) { this->seed(seed); }
+
+    // the same seed always produces the same noise. each lane gets its own state from it,
+    // skipping zero, which xorshift never leaves.
+    void seed(uint32_t value)
+    {
+      for (int i = 0; i < lanes; ++i)
+      {
+        value = value * 1664525u + 1013904223u;
+        mState[i] = value != 0 ? value : 0x9E3779B9u;
+      }
+    }
+
+    // nFrames must be a multiple of lanes
+    template<typename T>
+    void render(T* out, const int nFrames)
+    {
+      const T scale = (T)(1.0 / 2147483648.0);
+      int32_t bits[lanes];
+      for (int s = 0; s < nFrames; s += lanes)
+      {
+        step(bits);
+        for (int i = 0; i < lanes; ++i)
+        {
+          // read as signed the bits are already centered on zero
+          out[s + i] = bits[i] * scale;
+        }
+      }
+    }
+
+  private:
+    void step(int32_t* bits)
+    {
+#if SHAPER_KERNEL_AVX2 || SHAPER_KERNEL_SSE2
+      __m128i x = _mm_loadu_si128((const __m128i*)mState);
+      x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+      x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+      x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+      _mm_storeu_si128((__m128i*)mState, x);
+      _mm_storeu_si128((__m128i*)bits, x);
+#else
+      for (int i = 0; i < lanes; ++i)
+      {
+        uint32_t x = mState[i];
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        mState[i] = x;
+        bits[i] = (int32_t)x;
+      }
+#endif
+    }
+
+    alignas(16) uint32_t mState[lanes];
+  };
+
+  // turns white noise into pink noise in place with Paul Kellet's refined filter.
+  // the filter is a bank of one-pole lowpasses that all take the same input, so they are kept
+  // in arrays and updated together, which the compiler vectorizes across the bank.
+  template<typename T>
+  class pinkFilter
+  {
+  public:
+    pinkFilter()
+    {
+      for (T& b : mState) b = 0;
+      mDelayed = 0;
+    }
+
+    void render(T* inOut, const int nFrames)
+    {
+      static const T feedback[kPoles] = { (T)0.99886, (T)0.99332, (T)0.96900, (T)0.86650, (T)0.55000, (T)-0.7616, 0, 0 };
+      static const T gain[kPoles] = { (T)0.0555179, (T)0.0750759, (T)0.1538520, (T)0.3104856, (T)0.5329522, (T)-0.0168980, 0, 0 };
+      for (int s = 0; s < nFrames; ++s)
+      {
+        const T w = inOut[s];
+        T sum = 0;
+        for (int k = 0; k < kPoles; ++k)
+        {
+          mState[k] = feedback[k] * mState[k] + gain[k] * w;
+          sum += mState[k];
+        }
+        inOut[s] = (sum + mDelayed + w*(T)0.5362) * (T)0.11;
+        mDelayed = w*(T)0.115926;
+      }
+    }
+
+  private:
+    // six poles, padded out to a whole number of vectors
+    enum { kPoles = 8 };
+
+    T mState[kPoles];
+    T mDelayed;
+  };
+
+  // turns white noise into red noise in place with a leaky integrator
+  template<typename T>
+  class redFilter
+  {
+  public:
+    redFilter() : mState(0) {}
+
+    void render(T* inOut, const int nFrames)
+    {
+      const T leak = (T)(1.0 / 1.02);
+      const T gain = (T)(0.02 / 1.02);
+      T state = mState;
+      for (int s = 0; s < nFrames; ++s)
+      {
+        state = state * leak + inOut[s] * gain;
+        inOut[s] = state * (T)3.5;
+      }
+      mState = state;
+    }
+
+  private:
+    T mState;
+  };
+
+  // noise that advances to a new random value at a per-sample rate given in values per sample,
+  // linearly interpolating between values. a rate of zero freezes the output.
+  // the random values are generated a buffer at a time by the generators above.
+  template<typename T>
+  class noise
+  {
+  public:
+    noise(noiseTint::type tint, uint32_t seed = 0x9E3779B9u)
+      : tint(tint), mTint(tint), mWhite(seed), mRead(kPoolSize), mPhase(0), mPrev(0), mNext(0)
+    {
+    }
+
+    void seed(uint32_t value)
+    {
+      mWhite.seed(value);
+      mRead = kPoolSize;
+    }
+
+    // a change of tint is applied at the start of the next call. every frame goes through stage on its way out.
+    template<typename Stage = passThrough>
+    void render(T* out, const T* rate, const int nFrames, Stage stage = Stage())
+    {
+      if (tint != mTint)
+      {
+        // values already generated with the old tint are thrown away
+        mTint = tint;
+        mRead = kPoolSize;
+      }
+
+      for (int s = 0; s < nFrames; ++s)
+      {
+        mPhase += rate[s];
+        while (mPhase >= 1)
+        {
+          mPhase -= 1;
+          mPrev = mNext;
+          mNext = next();
+        }
+        out[s] = stage(mPrev + (mNext - mPrev)*mPhase, s);
+      }
+    }
+
+    noiseTint::type tint;
+
+  private:
+    enum { kPoolSize = 16 };
+
+    T next()
+    {
+      if (mRead == kPoolSize)
+      {
+        mWhite.render(mPool, kPoolSize);
+        switch (mTint)
+        {
+          case noiseTint::pink: mPink.render(mPool, kPoolSize); break;
+          case noiseTint::red: mRed.render(mPool, kPoolSize); break;
+          default: break;
+        }
+        mRead = 0;
+      }
+      return mPool[mRead++];
+    }
+
+    noiseTint::type mTint;
+    whiteNoise mWhite;
+    pinkFilter<T> mPink;
+    redFilter<T> mRed;
+    T mPool[kPoolSize];
+    int mRead;
+    T mPhase, mPrev, mNext;
+  };
+
+  // sine oscillator driven by a per-sample frequency in Hz.
+  // starts a quarter of the way through the cycle so that a frequency of zero outputs 1.
+  template<typename T>
+  class oscil
+  {
+  public:
+    oscil(T phase = 0.25) : mPhase(phase) {}
+
+    // out and hz may point to the same buffer. every frame goes through stage on its way out.
+    template<typename Stage = passThrough>
+    void render(T* out, const T* hz, const int nFrames, const T dt, Stage stage = Stage())
+    {
+      const T twoPi = (T)6.283185307179586;
+      for (int s = 0; s < nFrames; ++s)
+      {
+        const T step = hz[s] * dt;
+        out[s] = stage(std::sin(twoPi*mPhase), s);
+        mPhase += step;
+        mPhase -= std::floor(mPhase);
+      }
+    }
+
+    // moves the phase on by nFrames at a constant frequency without rendering them
+    void skip(const T hz, const int nFrames, const T dt)
+    {
+      mPhase += hz * dt * nFrames;
+      mPhase -= std::floor(mPhase);
+    }
+
+  private:
+    T mPhase;
+  };
+
+  // maps an input in the range [-1, 1] onto a stereo table, wrapping values outside of that range,
+  // and interpolates between neighboring frames. see ShaperKernel.h for the table layout.
+  template<typename T>
+  class waveshaper
+  {
+  public:
+    waveshaper(const T* table = nullptr, int size = 0)
+      : interpolation(shaperInterpolation::linear), mTable(table), mSize(size), mLastMapValue(0) {}
+
+    void setTable(const T* table, int size) { mTable = table; mSize = size; }
+    int getSize() const { return mSize; }
+
+    // normalized position in the table of the last lookup
+    T getLastMapValue() const { return mLastMapValue; }
+
+    void render(T* outLeft, T* outRight, const T* in, const int nFrames)
+    {
+      if (mSize < 2)
+      {
+        for (int s = 0; s < nFrames; ++s)
+        {
+          outLeft[s] = outRight[s] = 0;
+        }
+        return;
+      }
+
+      shaperLookup(interpolation, mTable, mSize, in, outLeft, outRight, nFrames);
+      if (nFrames > 0)
+      {
+        mLastMapValue = shaperMap(in[nFrames - 1]);
+      }
+    }
+
+    shaperInterpolation::type interpolation;
+
+  private:
+    const T* mTable;
+    int mSize;
+    T mLastMapValue;
+  };
+}
@@ -3,8 +3,11 @@
 #include "WaveShaper.h"
 #include "Params.h"
 #include "MultiChannelBuffer.h"
+#include "SampleLoader.h"
 #include "Interp.h"
 
+#include <algorithm>
+
 void ControlPoint::Draw(IGraphics& g, const IColor& color, const ControlPoint::Shape shape, float x, float y, float r, const IBlend* blend)
 {
   switch (shape)
@@ -282,6 +285,16 @@ void BangControl::OnMouseDown(float x, float y, const IMouseMod& pMod)
 		}
 		break;
 
+		case ActionCancelLoad:
+		{
+			PLUG_CLASS_NAME* plug = static_cast<PLUG_CLASS_NAME*>(GetDelegate());
+			if (plug != nullptr)
+			{
+				plug->CancelLoad();
+			}
+		}
+		break;
+
 		case ActionCustom:
 		default:
 		{
@@ -315,6 +328,8 @@ PeaksControl::PeaksControl(IRECT rect, IColor backColor, IColor peaksColor)
 	: IPanelControl(rect, backColor)
 	, mPeaksColor(peaksColor)
 	, mPeaksSize(rect.W())
+	, mProgress(-1)
+	, mMessage(nullptr)
 {
 	mPeaks = new float[mPeaksSize];
 	memset(mPeaks, 0, sizeof(float)*mPeaksSize);
@@ -337,39 +352,47 @@ void PeaksControl::Draw(IGraphics& g)
 		int y2 = mRECT.MH() - ph / 2;
 		g.DrawLine(mPeaksColor, x, y1, x, y2);
 	}
+
+	if (mProgress >= 0)
+	{
+		g.FillRect(mPeaksColor, IRECT(mRECT.L, mRECT.B - 2, mRECT.L + mRECT.W()*mProgress, mRECT.B));
+	}
+
+	if (mMessage != nullptr)
+	{
+		g.DrawText(mText, mMessage, mRECT);
+	}
 }
 
 void PeaksControl::UpdatePeaks(const Minim::MultiChannelBuffer& withSamples)
 {
-	// calculate peaks
-	const int chunkSize = withSamples.getBufferSize() / mPeaksSize;
-	const bool bStereo = withSamples.getChannelCount() == 2;
-	for (int i = 0; i < mPeaksSize; ++i)
+	SampleLoader::ComputePeaks(withSamples, mPeaks, (int)mPeaksSize);
+	SetDirty(false);
+}
+
+void PeaksControl::SetPeaks(const float* peaks, int count)
+{
+	memcpy(mPeaks, peaks, sizeof(float)*std::min((size_t)count, mPeaksSize));
+	SetDirty(false);
+}
+
+void PeaksControl::SetProgress(float progress)
+{
+	if (progress != mProgress)
 	{
-		float peak = 0;
-		int s = 0;
-		for (; s < chunkSize; ++s)
+		// a new load replaces whatever the last one had to say
+		if (progress >= 0)
 		{
-			int frame = i*chunkSize + s;
-			if (frame >= withSamples.getBufferSize())
-			{
-				break;
-			}
-			float val = 0;
-			if (bStereo)
-			{
-				val = (withSamples.getChannel(0)[frame] + withSamples.getChannel(1)[frame]) / 2.f;
-			}
-			else
-			{
-				val = withSamples.getChannel(0)[frame];
-			}
-			peak += val*val;
+			mMessage = nullptr;
 		}
-		peak /= s + 1;
-		mPeaks[i] = sqrtf(peak);
+		mProgress = progress;
+		SetDirty(false);
 	}
+}
 
+void PeaksControl::SetMessage(const char* message)
+{
+	mMessage = message;
 	SetDirty(false);
 }
 #pragma  endregion PeaksControl
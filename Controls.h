@@ -49,6 +49,7 @@ public:
 		ActionLoad, // by default will load fxp files only, specify fileTypes to handle different files
 		ActionSave, // by default will save fxp files only, specify fileTypes to save to different files
 		ActionDumpPreset,
+		ActionCancelLoad, // abandons the audio file being loaded in the background
 
 		// if the action is greater than or equal to this value,
 		// the Bang will call HandleAction on the owning plug
@@ -88,11 +89,21 @@ public:
 
 	void Draw(IGraphics& g) override;
 	void UpdatePeaks(const Minim::MultiChannelBuffer& withSamples);
+	// copies peaks measured ahead of time, see SampleLoader::ComputePeaks
+	void SetPeaks(const float* peaks, int count);
+	// how many peaks are drawn, one per pixel
+	int GetPeaksSize() const { return (int)mPeaksSize; }
+	// draws a bar along the bottom while a file loads, progress is -1 when nothing is loading
+	void SetProgress(float progress);
+	// draws message over the peaks until the next load starts, or nothing when message is null
+	void SetMessage(const char* message);
 
 private:
 	float* mPeaks;
 	size_t mPeaksSize;
 	IColor mPeaksColor;
+	float mProgress;
+	const char* mMessage;
 };
 
 // visualization of the section of the loaded file that is being scrubbed over
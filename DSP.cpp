@@ -1,5 +1,12 @@
 #include "DSP.h"
 
+#include "MultiChannelBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#if DSP_HAS_MINIM_ENGINE
 #include "Noise.h"
 #include "Multiplier.h"
 #include "Waves.h"
@@ -9,12 +16,12 @@
 #include "Pan.h"
 #include "Multiplier.h"
 #include "Summer.h"
-#include "MultiChannelBuffer.h"
 
 // this is hacky, but we can't compile the UGen source file as its own compilation unit becuase the file name is the same,
 // so we simply directly include it here.
-#include "ugens\Waveshaper.h"
-#include "ugens\Waveshaper.cpp"
+#include "ugens/Waveshaper.h"
+#include "ugens/Waveshaper.cpp"
+#endif
 
 #pragma region Settings
 extern const double kDefaultRate;
@@ -27,119 +34,24 @@ extern const double kEnvSustainDefault;
 extern const double kEnvReleaseDefault;
 #pragma endregion
 
+#if DSP_HAS_MINIM_ENGINE
 #pragma region ASDR
 ADSR::ADSR()
 	: UGen()
 	, audio(*this, AUDIO)
-	, mState(kOff)
-	, mAutoRelease(false)
-	, mAmp(0)
-	, mAttack(0)
-	, mDecay(0)
-	, mSustain(0)
-	, mRelease(0)
-	, mStep(0)
-	, mTime(0)
 {
-
-}
-
-void ADSR::sampleRateChanged()
-{
-	mStep = 1.0f / sampleRate();
 }
 
 void ADSR::noteOn(float amp, float attack, float decay, float sustain, float release)
 {
-	mTime = 0;
-	mAmp = amp;
-	mAttack = attack;
-	mDecay = decay;
-	mSustain = sustain;
-	mRelease = release;
-	mAutoRelease = false;
-
-	if (mAttack > 0) mState = kAttack;
-	else if (mDecay > 0) mState = kDecay;
-	else mState = kSustain;
-}
-
-void ADSR::noteOff()
-{
-	if (mState == kSustain)
-	{
-		mState = kRelease;
-		mTime = 0;
-	}
-	else
-	{
-		mAutoRelease = true;
-	}
-}
-
-void ADSR::stop()
-{
-	mState = kOff;
-	mAmp = 0;
+	mEnvelope.setSampleRate(sampleRate());
+	mEnvelope.noteOn(amp, attack, decay, sustain, release);
 }
 
 void ADSR::uGenerate(float * channels, const int numChannels)
 {
-	// when we are off, our amplitude should be zero, so we start with that and don't bother handling that case
-	float amp = 0;
-	switch (mState)
-	{
-	case kAttack:
-		if (mTime >= mAttack)
-		{
-			amp = mAmp;
-			mState = kDecay;
-			mTime = 0;
-		}
-		else
-		{
-			amp = mAmp * (mTime / mAttack);
-		}
-		break;
-
-	case kDecay:
-		if (mTime >= mDecay)
-		{
-			amp = mAmp * mSustain;
-			mState = kSustain;
-		}
-		else
-		{
-			const float t = mTime / mDecay;
-			amp = mAmp + t * (mAmp*mSustain - mAmp);
-		}
-		break;
-
-	case kSustain:
-		amp = mAmp * mSustain;
-		if (mAutoRelease)
-		{
-			mState = kRelease;
-			mTime = 0;
-		}
-		break;
-
-	case kRelease:
-		if (mTime >= mRelease)
-		{
-			amp = 0;
-			mState = kOff;
-		}
-		else
-		{
-			const float t = mTime / mRelease;
-			const float rAmp = mAmp*mSustain;
-			amp = rAmp - t*rAmp;
-		}
-		break;
-	}
-
-	mTime += mStep;
+	float amp;
+	mEnvelope.render(&amp, 1);
 
 	for (int i = 0; i < numChannels; ++i)
 	{
@@ -147,9 +59,11 @@ void ADSR::uGenerate(float * channels, const int numChannels)
 	}
 }
 #pragma endregion
+#endif
 
 #pragma region WaveShaperDSP
-WaveShaperDSP::WaveShaperDSP(int channelCount)
+template<typename T>
+WaveShaperDSP<T>::WaveShaperDSP(int channelCount)
   : mVolume(1.)
   , mAttack(kEnvAttackMin)
   , mDecay(kEnvDecayMin)
@@ -162,18 +76,29 @@ WaveShaperDSP::WaveShaperDSP(int channelCount)
   , mShape(kDefaultShape)
   , mShaperSize(0)
   , mShaperMapValue(0)
+  , mSignalDT(1.0 / 44100.0)
+  , mOversamplingRequest(1)
+#if DSP_HAS_MINIM_ENGINE
   , mMainSignalVol(0)
-  , vNoize(vessl::noiseTint::pink)
-  , vNoizeAmp(1)
-  , vNoizeMod(vessl::waves<sample>::sine, kDefaultMod)
-  , vRateCtrl(0, 0, 0.01)
-  , vModCtrl(kDefaultMod, kDefaultMod)
-  , vRangeCtrl(kDefaultRange, kDefaultRange)
-  , vShapeCtrl(kDefaultShape, kDefaultShape)
-  , vNoizeShaperLeft(mBufferLeft)
-  , vNoizeShaperRight(mBufferRight)
-  , vNoizeShaperMixer(1)
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+  , mFadeLength(0)
+  , mFadeRemaining(0)
+  , mOversampling(1)
+  , mSilentFrames(0)
+  , mNewestVoice(0)
+  , mVoiceClock(0)
+  , vModCtrl(kDefaultMod)
+  , vRangeCtrl(kDefaultRange)
+  , vShapeCtrl(kDefaultShape)
+  , vVolumeCtrl(1., block::smoothing::onePole)
+#endif
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  , mNullVoiceRendered(false)
+  , mNullFrame(0)
+#endif
 {
+#if DSP_HAS_MINIM_ENGINE
   mNoizeRate = new Minim::TickRate(mRate);
   mNoizeRate->setInterpolation(true);
 
@@ -232,23 +157,24 @@ WaveShaperDSP::WaveShaperDSP(int channelCount)
 
   mMainSignal->patch(mEnvelope).patch(mMainSignalVol);
   mMainSignalVol.setAudioChannelCount(channelCount);
- 
-  vMainSignal.patch(vRateCtrl.value, vNoize.rate);
-  vMainSignal.patch(vModCtrl.value, vNoizeMod.fhz);
-  vMainSignal.patch(vNoizeMod.out, vNoizeModAmp.in);
-  vMainSignal.patch(vShapeCtrl.value, vNoizeModAmp.factor);
-  vMainSignal.patch(vNoizeModAmp.out, vNoizeAmp.factor);
+#endif
 
-  // offset value is summed with the noise to control where in the wavetable we are scrubbing
-  vMainSignal.patch(vNoize.out, vNoizeAmp.in).patch(vNoizeAmp.out, vNoizeSum.in[0]);
-  vMainSignal.patch(vRangeCtrl.value, vNoizeSum.in[1]);
-
-  vMainSignal.patch(vNoizeSum.out, vNoizeShaperLeft.in).patch(vNoizeShaperLeft.out, vNoizeShaperMixer.in[0]);
-  vMainSignal.patch(vNoizeSum.out, vNoizeShaperRight.in).patch(vNoizeShaperRight.out, vNoizeShaperMixer.in[1]);
+#if DSP_HAS_BLOCK_ENGINE
+  // voices playing the same settings would otherwise scrub in lockstep
+  for (int i = 0; i < DSP_VOICE_COUNT; ++i)
+  {
+    mVoices[i].noise.seed(0x9E3779B9u + i * 0x6C8E9CF5u);
+    mVoices[i].position = 0;
+    mVoices[i].lastScrub = 0;
+    std::fill(mVoices[i].envHistory, mVoices[i].envHistory + Voice::kEnvHistory, (T)0);
+  }
+#endif
 }
 
-WaveShaperDSP::~WaveShaperDSP()
+template<typename T>
+WaveShaperDSP<T>::~WaveShaperDSP()
 {
+#if DSP_HAS_MINIM_ENGINE
   delete mNoize;
   delete mNoizeRate;
   delete mNoizeAmp;
@@ -260,92 +186,765 @@ WaveShaperDSP::~WaveShaperDSP()
   delete mPanRight;
   delete mNoizeMod;
   delete mMainSignal;
+#endif
 }
 
-void WaveShaperDSP::ProcessBlock(sample** inputs, sample** outputs, int nOutputs, int nFrames)
+template<typename T>
+void WaveShaperDSP<T>::Reset(double sampleRate, int blockSize)
 {
-  sample* out1 = outputs[0];
-  sample* out2 = outputs[1];
+  mMidiQueue.Clear();
+  mMidiQueue.Resize(blockSize);
+  mSignalDT = 1.0 / sampleRate;
+
+#if DSP_HAS_MINIM_ENGINE
+  mMainSignalVol.setSampleRate((float)sampleRate);
+  mMinimLeft.resize(blockSize);
+  mMinimRight.resize(blockSize);
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+  for (Voice& voice : mVoices)
+  {
+    voice.envelope.setSampleRate((float)sampleRate);
+  }
+#endif
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  mNullRate.resize(blockSize);
+  mNullNoise.resize(blockSize);
+  mNullScrub.resize(blockSize);
+  mNullMod.resize(blockSize);
+  mNullRange.resize(blockSize);
+  mNullEnv.resize(blockSize);
+  mNullFrame = 0;
+  memset(&mNullReport, 0, sizeof(mNullReport));
+#endif
+}
 
-  float result[2];
-  for (int s = 0; s < nFrames; ++s, ++out1, ++out2)
+template<typename T>
+void WaveShaperDSP<T>::ProcessBlock(sample** inputs, sample** outputs, int nOutputs, int nFrames)
+{
+#if DSP_HAS_BLOCK_ENGINE
+  if (mOversamplingRequest != mOversampling)
+  {
+    UpdateOversampling();
+  }
+
+  // wavetables loaded on the UI thread are only picked up here, between blocks
+  if (mWavetables.Update())
+  {
+    BeginWavetableFade();
+  }
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_BLOCK
+  // with no notes coming and none left sounding the graph would only produce zeros,
+  // so write those directly. the Minim graph is the reference and is always ticked.
+  if (mMidiQueue.Empty() && IsIdle())
+  {
+    for (int c = 0; c < nOutputs; ++c)
+    {
+      memset(outputs[c], 0, nFrames * sizeof(sample));
+    }
+    SkipBlock(nFrames);
+    return;
+  }
+#endif
+
+  int s = 0;
+  while (s < nFrames)
+  {
+    // apply everything that is due now and then render straight through to the next event,
+    // which means a block without any MIDI in it is rendered with a single call.
+    while (!mMidiQueue.Empty() && mMidiQueue.Peek().mOffset <= s)
+    {
+      HandleMidiMsg(mMidiQueue.Peek());
+      mMidiQueue.Remove();
+    }
+
+    int spanEnd = nFrames;
+    if (!mMidiQueue.Empty() && mMidiQueue.Peek().mOffset < nFrames)
+    {
+      spanEnd = mMidiQueue.Peek().mOffset;
+    }
+
+    RenderSpan(outputs, nOutputs, s, spanEnd - s);
+    s = spanEnd;
+  }
+
+  // anything left in the queue belongs to a later block
+  mMidiQueue.Flush(nFrames);
+
+#if DSP_HAS_MINIM_ENGINE
+  mShaperMapValue = mNoizeShaperLeft->getLastMapValue();
+#else
+  mShaperMapValue = (float)mVoices[mNewestVoice].position;
+#endif
+}
+
+template<typename T>
+int WaveShaperDSP<T>::GetLatency() const
+{
+#if DSP_ENGINE == DSP_ENGINE_BLOCK
+  // the host only takes whole frames, so at 4x and 8x the output is still up to half a frame off
+  return (int)(block::oversamplingLatency(mOversamplingRequest) + 0.5);
+#else
+  // the Minim graph is never oversampled
+  return 0;
+#endif
+}
+
+template<typename T>
+void WaveShaperDSP<T>::SetInterpolation(block::shaperInterpolation::type value)
+{
+#if DSP_HAS_BLOCK_ENGINE
+  vNoizeShaper.interpolation = value;
+  vFadeShaper.interpolation = value;
+#endif
+}
+
+template<typename T>
+void WaveShaperDSP<T>::SetEnvelopeCurve(Envelope::Curve value)
+{
+#if DSP_HAS_MINIM_ENGINE
+  mEnvelope.setCurve(value);
+#endif
+
+#if DSP_HAS_BLOCK_ENGINE
+  for (Voice& voice : mVoices)
+  {
+    voice.envelope.setCurve(value);
+  }
+#endif
+}
+
+template<typename T>
+void WaveShaperDSP<T>::SetNoiseRate(double value)
+{
+  mRate = value;
+
+#if DSP_HAS_MINIM_ENGINE
+  if (!mMidiNotes.Empty())
+  {
+    mRateCtrl.activate(0.01, mRateCtrl.getAmp(), value);
+  }
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+  // released voices keep winding down to a stop.
+  // the rate is heard on a log scale, so it glides exponentially between held values.
+  for (Voice& voice : mVoices)
   {
-    while (!mMidiQueue.Empty())
+    if (voice.note != Voice::kNoNote)
     {
-      IMidiMsg& pMsg = mMidiQueue.Peek();
-      if (pMsg.mOffset > s) break;
+      voice.rate.rampTo((T)value, (T)0.01);
+    }
+  }
+#endif
+}
 
-      switch (pMsg.StatusMsg())
+template<typename T>
+void WaveShaperDSP<T>::HandleMidiMsg(const IMidiMsg& msg)
+{
+  switch (msg.StatusMsg())
+  {
+    case IMidiMsg::kNoteOn:
+      // make sure this is a real NoteOn
+      if (msg.Velocity() > 0)
       {
-        case IMidiMsg::kNoteOn:
-          // make sure this is a real NoteOn
-          if (pMsg.Velocity() > 0)
-          {
-            mMidiNotes.push_back(pMsg);
-            if (!mEnvelope.isOn())
-            {
-              mEnvelope.noteOn(pMsg.Velocity() / 127.0f, mAttack, mDecay, mSustain, mRelease);
-              TriggerRateChange(mRate, 0.01);
-            }
-            break;
-          }
-          // fallthru in the case that a NoteOn is supposed to be treated like a NoteOff
-
-        case IMidiMsg::kNoteOff:
-          for (auto iter = mMidiNotes.crbegin(); iter != mMidiNotes.crend(); ++iter)
-          {
-            // remove the most recent note on with the same pitch
-            if (pMsg.NoteNumber() == iter->NoteNumber())
-            {
-              mMidiNotes.erase((iter + 1).base());
-              break;
-            }
-          }
-
-          if (mMidiNotes.empty())
-          {
-            mEnvelope.noteOff();
-            TriggerRateChange(0, mEnvelope.getRelease());
-          }
-          break;
+#if DSP_HAS_MINIM_ENGINE
+        if (!mEnvelope.isOn())
+        {
+          mEnvelope.noteOn(msg.Velocity() / 127.0f, mAttack, mDecay, mSustain, mRelease);
+          mRateCtrl.activate(0.01, mRateCtrl.getAmp(), mRate);
+        }
+#endif
+        mMidiNotes.Push(msg);
+#if DSP_HAS_BLOCK_ENGINE
+        NoteOn(msg);
+#endif
+        break;
       }
+      // fallthru in the case that a NoteOn is supposed to be treated like a NoteOff
 
-      mMidiQueue.Remove();
+    case IMidiMsg::kNoteOff:
+      mMidiNotes.Remove(msg);
+
+#if DSP_HAS_MINIM_ENGINE
+      if (mMidiNotes.Empty())
+      {
+        mEnvelope.noteOff();
+        mRateCtrl.activate(mEnvelope.getRelease(), mRateCtrl.getAmp(), 0);
+      }
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+      NoteOff(msg);
+#endif
+      break;
+  }
+}
+
+#if DSP_HAS_BLOCK_ENGINE
+static int VoiceNote(const IMidiMsg& msg)
+{
+  return msg.Channel() * NoteStack::kNotesPerChannel + (msg.NoteNumber() & (NoteStack::kNotesPerChannel - 1));
+}
+
+template<typename T>
+void WaveShaperDSP<T>::NoteOn(const IMidiMsg& msg)
+{
+  Voice* voice = nullptr;
+#if DSP_VOICE_COUNT == 1
+  // legato: the note only retriggers when nothing is held
+  voice = &mVoices[0];
+  if (voice->envelope.isOn())
+  {
+    voice->note = VoiceNote(msg);
+    return;
+  }
+#else
+  // a key pressed again while it is still held retriggers its own voice
+  const int note = VoiceNote(msg);
+  for (Voice& held : mVoices)
+  {
+    if (held.note == note)
+    {
+      voice = &held;
+      break;
+    }
+  }
+  if (voice == nullptr)
+  {
+    voice = &AllocateVoice();
+  }
+#endif
+
+  // a voice that has gone quiet starts over with empty filters. one that is still sounding keeps them,
+  // along with the level of its envelope, so the new note carries on from the old one without a click.
+  if (!voice->envelope.isSounding())
+  {
+    voice->scrubUp.reset();
+    std::fill(voice->envHistory, voice->envHistory + Voice::kEnvHistory, (T)0);
+  }
+
+  voice->envelope.noteOn(msg.Velocity() / 127.0f, mAttack, mDecay, mSustain, mRelease);
+  voice->rate.rampTo((T)mRate, (T)0.01);
+  voice->note = VoiceNote(msg);
+  voice->age = ++mVoiceClock;
+  mNewestVoice = (int)(voice - mVoices);
+}
+
+template<typename T>
+void WaveShaperDSP<T>::NoteOff(const IMidiMsg& msg)
+{
+#if DSP_VOICE_COUNT == 1
+  if (mMidiNotes.Empty() && mVoices[0].note != Voice::kNoNote)
+  {
+    ReleaseVoice(mVoices[0]);
+  }
+#else
+  // the voice is only released once every press of its key has been released
+  const int note = VoiceNote(msg);
+  if (mMidiNotes.IsHeld(msg))
+  {
+    return;
+  }
+
+  for (Voice& voice : mVoices)
+  {
+    if (voice.note == note)
+    {
+      ReleaseVoice(voice);
+    }
+  }
+#endif
+}
+
+template<typename T>
+typename WaveShaperDSP<T>::Voice& WaveShaperDSP<T>::AllocateVoice()
+{
+  Voice* quietest = nullptr;
+  Voice* oldest = nullptr;
+  for (Voice& voice : mVoices)
+  {
+    if (!voice.envelope.isSounding())
+    {
+      return voice;
+    }
+
+    if (voice.note == Voice::kNoNote)
+    {
+      if (quietest == nullptr || voice.envelope.getLevel() < quietest->envelope.getLevel())
+      {
+        quietest = &voice;
+      }
+    }
+    else if (oldest == nullptr || voice.age < oldest->age)
+    {
+      oldest = &voice;
+    }
+  }
+
+  return quietest != nullptr ? *quietest : *oldest;
+}
+
+template<typename T>
+void WaveShaperDSP<T>::ReleaseVoice(Voice& voice)
+{
+  voice.envelope.noteOff();
+  voice.rate.rampTo(0, (T)voice.envelope.getRelease());
+  voice.note = Voice::kNoNote;
+}
+#endif
+
+template<typename T>
+void WaveShaperDSP<T>::RenderSpan(sample** outputs, int nOutputs, int offset, int nFrames)
+{
+#if DSP_HAS_MINIM_ENGINE
+  RenderMinimSpan(outputs, nOutputs, offset, nFrames);
+#endif
+
+#if DSP_HAS_BLOCK_ENGINE
+  for (Voice& voice : mVoices)
+  {
+    voice.noise.tint = (block::noiseTint::type)mNoiseTint;
+  }
+
+  for (int start = offset; start < offset + nFrames; start += DSP_BLOCK_SIZE)
+  {
+    const int blockFrames = offset + nFrames - start < DSP_BLOCK_SIZE ? offset + nFrames - start : DSP_BLOCK_SIZE;
+    RenderBlock(mBlockOutLeft, mBlockOutRight, blockFrames);
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+    NullTest(start, blockFrames);
+#else
+    WriteOutputs(outputs, nOutputs, start, mBlockOutLeft, mBlockOutRight, blockFrames);
+#endif
+  }
+#endif
+}
+
+// copies a channel of the graph into a host buffer, converting it when the two precisions differ
+static void CopyChannel(sample* out, const sample* in, int nFrames)
+{
+  memcpy(out, in, nFrames * sizeof(sample));
+}
+
+template<typename U>
+static void CopyChannel(sample* out, const U* in, int nFrames)
+{
+  for (int s = 0; s < nFrames; ++s)
+  {
+    out[s] = (sample)in[s];
+  }
+}
+
+template<typename T>
+template<typename U>
+void WaveShaperDSP<T>::WriteOutputs(sample** outputs, int nOutputs, int offset, const U* left, const U* right, int nFrames)
+{
+  if (nOutputs == 1)
+  {
+    sample* out = outputs[0] + offset;
+    for (int s = 0; s < nFrames; ++s)
+    {
+      out[s] = (sample)((left[s] + right[s]) * (U)0.5);
     }
+    return;
+  }
+
+  for (int c = 0; c < nOutputs; ++c)
+  {
+    CopyChannel(outputs[c] + offset, c % 2 == 0 ? left : right, nFrames);
+  }
+}
+
+#if DSP_HAS_MINIM_ENGINE
+template<typename T>
+void WaveShaperDSP<T>::RenderMinimSpan(sample** outputs, int nOutputs, int offset, int nFrames)
+{
+  // like the block graph, a tint change is picked up between spans
+  mNoize->setTint(mNoiseTint);
 
-    mNoize->setTint(mNoiseTint);
+  // each shaper is panned hard to its own side, so the two channels are the left and right shapers
+  float result[2];
+  for (int s = offset; s < offset + nFrames; ++s)
+  {
     mMainSignalVol.amplitude.setLastValue(mVolume);
     mMainSignalVol.tick(result, 2);
 
-    *out1 = result[0];
-    *out2 = result[0];
+    mMinimLeft[s] = result[0];
+    mMinimRight[s] = result[1];
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+    mNullRate[s] = mNoizeRate->value.getLastValue();
+    mNullNoise[s] = mNoizeRate->getLastValues()[0];
+    mNullScrub[s] = mNoizeSum->getLastValues()[0];
+    mNullMod[s] = mNoizeMod->getLastValues()[0];
+    mNullRange[s] = mNoizeOffset->getLastValues()[0];
+    mNullEnv[s] = mEnvelope.getLevel();
+#endif
+  }
 
-    vNoize.tint = (vessl::noiseTint::type)mNoiseTint;
-    vNoizeShaperMixer.master = mVolume;
-    auto& out = vMainSignal.tick(mSignalDT);
-    result[0] = out[0];
-    result[1] = out[1];
+  WriteOutputs(outputs, nOutputs, offset, &mMinimLeft[offset], &mMinimRight[offset], nFrames);
+}
+#endif
+
+#if DSP_HAS_BLOCK_ENGINE
+template<typename T>
+void WaveShaperDSP<T>::RenderBlock(T* outLeft, T* outRight, int nFrames)
+{
+  const T dt = (T)mSignalDT;
+  // the parts of the graph every voice shares are rendered once
+  vModCtrl.render(mBlockMod, nFrames, dt);
+  vShapeCtrl.render(mBlockShape, nFrames, dt);
+  vRangeCtrl.render(mBlockRange, nFrames, dt);
+
+  // the mod frequencies are replaced with the oscillator output, scaled by the shape
+  vNoizeMod.render(mBlockMod, mBlockMod, nFrames, dt, block::multiplyBy<T>{ mBlockShape });
+
+  const bool fading = mFadeRemaining > 0;
+  if (fading)
+  {
+    const T fadeStep = (T)1 / mFadeLength;
+    for (int s = 0; s < nFrames; ++s)
+    {
+      mBlockFade[s] = mFadeRemaining > 0 ? mFadeRemaining-- * fadeStep : 0;
+    }
   }
 
-  mShaperMapValue = mNoizeShaperLeft->getLastMapValue();
+  // without oversampling the voices are mixed straight into the output
+  const int overFrames = nFrames * mOversampling;
+  T* mixLeft = mOversampling > 1 ? mBlockMixLeft : outLeft;
+  T* mixRight = mOversampling > 1 ? mBlockMixRight : outRight;
+  for (int s = 0; s < overFrames; ++s)
+  {
+    mixLeft[s] = mixRight[s] = 0;
+  }
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  // the null test reads the envelope even when the voice is silent
+  for (int s = 0; s < nFrames; ++s)
+  {
+    mBlockEnv[s] = 0;
+  }
+#endif
+
+  bool sounding = false;
+  for (Voice& voice : mVoices)
+  {
+    if (voice.envelope.isSounding())
+    {
+      RenderVoice(voice, mixLeft, mixRight, nFrames, fading);
+      sounding = true;
+    }
+  }
+  mSilentFrames = sounding ? 0 : mSilentFrames + nFrames;
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  mNullVoiceRendered = sounding;
+#endif
+
+  if (fading && mFadeRemaining == 0)
+  {
+    mWavetables.ReleasePrevious();
+  }
+
+  if (mOversampling > 1)
+  {
+    // the filters keep running while nothing is sounding so that their tails are not cut off
+    vMixDownLeft.render(outLeft, mixLeft, nFrames, mBlockLeft);
+    vMixDownRight.render(outRight, mixRight, nFrames, mBlockLeft);
+  }
+
+  if (vVolumeCtrl.isSettled())
+  {
+    const T volume = vVolumeCtrl.getValue();
+    for (int s = 0; s < nFrames; ++s)
+    {
+      outLeft[s] *= volume;
+      outRight[s] *= volume;
+    }
+  }
+  else
+  {
+    vVolumeCtrl.render(mBlockVolume, nFrames, dt);
+    for (int s = 0; s < nFrames; ++s)
+    {
+      outLeft[s] *= mBlockVolume[s];
+      outRight[s] *= mBlockVolume[s];
+    }
+  }
+}
+
+template<typename T>
+void WaveShaperDSP<T>::RenderVoice(Voice& voice, T* outLeft, T* outRight, int nFrames, bool fading)
+{
+  const T dt = (T)mSignalDT;
+  voice.rate.render(mBlockRate, nFrames, dt);
+  voice.envelope.render(mBlockEnv, nFrames);
+
+  // the noise is scaled by the mod and the offset value is summed with it to control where in the
+  // wavetable we are scrubbing, all in the noise's own loop. the fastest the scrub moves is measured
+  // along the way, see below.
+  block::peakStep<T> scrubSpeed{ voice.lastScrub, 0 };
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  // the null test compares the noise before the mod and range are applied to it
+  const auto scale = block::pipe(block::copyTo<T>{ mBlockNoise }, block::multiplyBy<T>{ mBlockMod });
+#else
+  const auto scale = block::multiplyBy<T>{ mBlockMod };
+#endif
+  voice.noise.render(mBlockScrub, mBlockRate, nFrames,
+                     block::pipe(block::pipe(scale, block::offsetBy<T>{ mBlockRange }), std::ref(scrubSpeed)));
+  voice.lastScrub = scrubSpeed.previous;
+
+  // the lookup is what aliases when the scrub moves quickly, so it runs at the oversampled rate.
+  // the envelope is brought up to that rate alongside the scrub, the fade gains change slowly
+  // enough to be held for each oversampled frame.
+  const int factor = mOversampling;
+  const int overFrames = nFrames * factor;
+  const T* scrub = mBlockScrub;
+  const T* env = mBlockEnv;
+  if (factor > 1)
+  {
+    voice.scrubUp.render(mBlockScrubUp, mBlockScrub, nFrames, mBlockLeft);
+    scrub = mBlockScrubUp;
+    DelayEnvelope(voice, nFrames);
+    env = mBlockEnvUp;
+  }
+
+  // once the scrub skips over frames of the table it reads from a more band-limited level instead.
+  // the speed is in frames of the full table per lookup, and a scrub of 2 covers the whole table.
+  const typename WavetableStore<T>::Table* table = mWavetables.GetCurrent();
+  const T speed = scrubSpeed.peak * (T)0.5 * (table != nullptr ? table->size - 1 : 0) / factor;
+  const T level = speed > 1 ? std::log2(speed) : 0;
+
+  RenderLookup(vNoizeShaper, table, level, scrub, mBlockLeft, mBlockRight, overFrames);
+  voice.position = vNoizeShaper.getLastMapValue();
+
+  // the crossfade, the envelope and the mix are applied in a single pass
+  if (fading)
+  {
+    RenderLookup(vFadeShaper, mWavetables.GetPrevious(), level, scrub, mBlockFadeLeft, mBlockFadeRight, overFrames);
+    for (int s = 0, i = 0; s < nFrames; ++s)
+    {
+      const T fade = mBlockFade[s];
+      for (int end = i + factor; i < end; ++i)
+      {
+        outLeft[i] += (mBlockLeft[i] + (mBlockFadeLeft[i] - mBlockLeft[i]) * fade) * env[i];
+        outRight[i] += (mBlockRight[i] + (mBlockFadeRight[i] - mBlockRight[i]) * fade) * env[i];
+      }
+    }
+    return;
+  }
+
+  for (int i = 0; i < overFrames; ++i)
+  {
+    outLeft[i] += mBlockLeft[i] * env[i];
+    outRight[i] += mBlockRight[i] * env[i];
+  }
+}
+
+template<typename T>
+void WaveShaperDSP<T>::DelayEnvelope(Voice& voice, int nFrames)
+{
+  const int factor = mOversampling;
+  T* env = mBlockEnvDelay;
+  std::copy(voice.envHistory, voice.envHistory + Voice::kEnvHistory, env);
+  std::copy(mBlockEnv, mBlockEnv + nFrames, env + Voice::kEnvHistory);
+
+  // the way up is half of the round trip, and always comes to a whole number of oversampled frames
+  const int delay = (int)(block::oversamplingLatency(factor) * factor / 2);
+  const T step = (T)1 / factor;
+  for (int i = 0, overFrames = nFrames * factor; i < overFrames; ++i)
+  {
+    // interpolated between frames rather than held, so the envelope isn't late by part of a frame either
+    const int position = Voice::kEnvHistory * factor + i - delay;
+    const int frame = position / factor;
+    const T blend = (position - frame * factor) * step;
+    mBlockEnvUp[i] = env[frame] + (env[frame + 1] - env[frame]) * blend;
+  }
+
+  std::copy(env + nFrames, env + nFrames + Voice::kEnvHistory, voice.envHistory);
+}
+
+template<typename T>
+void WaveShaperDSP<T>::RenderLookup(block::waveshaper<T>& shaper, const typename WavetableStore<T>::Table* table, T level,
+                                 const T* scrub, T* outLeft, T* outRight, int nFrames)
+{
+  if (table == nullptr || table->levels == 0)
+  {
+    shaper.setTable(nullptr, 0);
+    shaper.render(outLeft, outRight, scrub, nFrames);
+    return;
+  }
+
+  const int lastLevel = table->levels - 1;
+  const int lower = std::min((int)level, lastLevel);
+  const T blend = lower < lastLevel ? level - lower : 0;
+
+  if (blend > 0)
+  {
+    shaper.setTable(table->level[lower + 1], table->levelSize[lower + 1]);
+    shaper.render(mBlockMipLeft, mBlockMipRight, scrub, nFrames);
+  }
+
+  shaper.setTable(table->level[lower], table->levelSize[lower]);
+  shaper.render(outLeft, outRight, scrub, nFrames);
+
+  if (blend > 0)
+  {
+    for (int s = 0; s < nFrames; ++s)
+    {
+      outLeft[s] += (mBlockMipLeft[s] - outLeft[s]) * blend;
+      outRight[s] += (mBlockMipRight[s] - outRight[s]) * blend;
+    }
+  }
+}
+
+template<typename T>
+void WaveShaperDSP<T>::UpdateOversampling()
+{
+  mOversampling = mOversamplingRequest;
+  for (Voice& voice : mVoices)
+  {
+    voice.scrubUp.setFactor(mOversampling);
+    std::fill(voice.envHistory, voice.envHistory + Voice::kEnvHistory, (T)0);
+  }
+  vMixDownLeft.setFactor(mOversampling);
+  vMixDownRight.setFactor(mOversampling);
 }
 
-void WaveShaperDSP::SetWavetables(Minim::MultiChannelBuffer& buffer)
+template<typename T>
+void WaveShaperDSP<T>::SkipBlock(int nFrames)
 {
-  const float* left = buffer.getChannel(0);
-  const float* right = buffer.getChannelCount() > 1 ? buffer.getChannel(1) : left;
-  const int size = buffer.getBufferSize();
+  const T dt = (T)mSignalDT;
+  // the mod oscillator is the only thing that runs freely. its frequency is averaged over the
+  // skipped frames, which is exact while the control is settled, as it almost always is here.
+  const T modFrom = vModCtrl.getValue();
+  vModCtrl.skip(nFrames, dt);
+  vShapeCtrl.skip(nFrames, dt);
+  vRangeCtrl.skip(nFrames, dt);
+  vVolumeCtrl.skip(nFrames, dt);
+  const T modTo = vModCtrl.getValue();
+  vNoizeMod.skip((modFrom + modTo) * (T)0.5, nFrames, dt);
+
+  for (Voice& voice : mVoices)
+  {
+    voice.rate.skip(nFrames, dt);
+  }
+}
+
+template<typename T>
+void WaveShaperDSP<T>::BeginWavetableFade()
+{
+  // the shapers are pointed at the levels of the two tables as each voice renders
+  const typename WavetableStore<T>::Table* previous = mWavetables.GetPrevious();
+  if (previous != nullptr && previous->size > 1)
+  {
+    mFadeLength = mFadeRemaining = std::max(1, (int)(DSP_WAVETABLE_FADE_TIME / mSignalDT));
+  }
+  else
+  {
+    // nothing worth fading from, so the previous table can go straight back
+    mWavetables.ReleasePrevious();
+    mFadeRemaining = 0;
+  }
+}
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+template<typename T>
+const char* WaveShaperDSP<T>::NullTestReport::PathName(int path)
+{
+  static const char* names[kPathCount] = { "rate", "mod", "range", "envelope", "scrub", "output" };
+  return path >= 0 && path < kPathCount ? names[path] : "";
+}
+
+template<typename T>
+void WaveShaperDSP<T>::NullTest(int offset, int nFrames)
+{
+  // the two graphs use different random number generators, so the noise is only compared by its level.
+  // every stage after it is compared by putting the Minim graph's values through the block graph's.
+  // the Minim shaper only interpolates linearly
+  const block::shaperInterpolation::type interpolation = vNoizeShaper.interpolation;
+  vNoizeShaper.interpolation = block::shaperInterpolation::linear;
+  // the Minim scrub is float, so it is brought to the graph's precision first
+  for (int s = 0; s < nFrames; ++s)
+  {
+    mBlockScrubUp[s] = (T)mNullScrub[offset + s];
+  }
+  RenderLookup(vNoizeShaper, mWavetables.GetCurrent(), 0, mBlockScrubUp, mBlockLeft, mBlockRight, nFrames);
+  vNoizeShaper.interpolation = interpolation;
 
-  mNoizeShaperLeft->getWavetable().setWaveform(left, size);
-  mNoizeShaperRight->getWavetable().setWaveform(right, size);
+  NullTestReport& report = mNullReport;
+  const auto compare = [&](int path, double block, double minim, int s)
+  {
+    const double error = std::abs(block - minim);
+    if (error > report.maxError[path])
+    {
+      report.maxError[path] = error;
+      report.maxErrorFrame[path] = mNullFrame + s;
+    }
+  };
 
-  for (int i = 0; i < size; ++i)
+  // the rate is a tiny fraction of a value per frame, so it is compared relative to the rate being played
+  const double rateScale = 1.0 / std::max(std::abs(mRate), 1e-9);
+  const int tint = (int)mNoiseTint;
+  for (int s = 0; s < nFrames; ++s)
   {
-    mBufferLeft.set(i, left[i]);
-    mBufferRight.set(i, right[i]);
+    const int m = offset + s;
+    compare(NullTestReport::kMod, mBlockMod[s], mNullMod[m], s);
+    compare(NullTestReport::kRange, mBlockRange[s], mNullRange[m], s);
+    compare(NullTestReport::kEnvelope, mBlockEnv[s], mNullEnv[m], s);
+    compare(NullTestReport::kOutput, mBlockLeft[s] * mBlockEnv[s] * (T)mVolume, mMinimLeft[m], s);
+    compare(NullTestReport::kOutput, mBlockRight[s] * mBlockEnv[s] * (T)mVolume, mMinimRight[m], s);
+    // the Minim noise put through the same stages the block voice puts its own noise through
+    compare(NullTestReport::kScrub, (T)mNullNoise[m] * mBlockMod[s] + mBlockRange[s], mNullScrub[m], s);
+
+    // a voice that has stopped leaves its rate and noise where they were
+    if (mNullVoiceRendered)
+    {
+      compare(NullTestReport::kRate, mBlockRate[s] * rateScale, mNullRate[m] * rateScale, s);
+      report.minimNoise[tint] += (double)mNullNoise[m] * mNullNoise[m];
+      report.blockNoise[tint] += (double)mBlockNoise[s] * mBlockNoise[s];
+      ++report.noiseFrames[tint];
+    }
   }
 
+  mNullFrame += nFrames;
+}
+#endif
+
+template<typename T>
+void WaveShaperDSP<T>::SetWavetables(const SampleCache::Handle& source)
+{
+  const int size = source->buffer.getBufferSize();
+
+#if DSP_HAS_MINIM_ENGINE
+  // the Minim engine is only kept as a reference, so its tables are still replaced in place
+  if (size > 0)
+  {
+    const float* left = source->buffer.getChannel(0);
+    const float* right = source->buffer.getChannelCount() > 1 ? source->buffer.getChannel(1) : left;
+    mNoizeShaperLeft->getWavetable().setWaveform(left, size);
+    mNoizeShaperRight->getWavetable().setWaveform(right, size);
+  }
+#endif
+
+#if DSP_HAS_BLOCK_ENGINE
+  // picked up by the audio thread at the start of the next block
+  mWavetables.Load(SampleCache::GetTable<T>(source));
+#endif
+
   mShaperSize = size;
 }
 
+template<typename T>
+void WaveShaperDSP<T>::FreeUnusedWavetables()
+{
+#if DSP_HAS_BLOCK_ENGINE
+  mWavetables.FreeUnused();
+#endif
+}
+
+
+template class WaveShaperDSP<float>;
+template class WaveShaperDSP<double>;
 #pragma endregion
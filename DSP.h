@@ -2,56 +2,111 @@
 
 #include "IPlugStructs.h"
 #include "UGen.h"
-#include "Line.h"
-#include "Multiplier.h"
-#include "Constant.h"
 #include "Noise.h"
-#include "TickRate.h"
 
-#include "vessl.h"
+#include "BlockDSP.h"
+#include "Envelope.h"
+#include "NoteStack.h"
+#include "Oversampler.h"
+#include "SampleCache.h"
+#include "WavetableStore.h"
 
 #include <vector>
 
-#define BUFFER_SIZE 44100*4
+// selects which synthesis graph WaveShaperDSP is built with, only that graph is compiled in.
+// the null test build runs both, outputs the Minim graph and keeps a report of how far the block
+// graph strays from it on every path, which tools/NullTest.cpp renders and checks offline.
+#define DSP_ENGINE_BLOCK    0
+#define DSP_ENGINE_MINIM    1
+#define DSP_ENGINE_NULLTEST 2
+
+#ifndef DSP_ENGINE
+#define DSP_ENGINE DSP_ENGINE_BLOCK
+#endif
+
+#define DSP_HAS_BLOCK_ENGINE (DSP_ENGINE != DSP_ENGINE_MINIM)
+#define DSP_HAS_MINIM_ENGINE (DSP_ENGINE != DSP_ENGINE_BLOCK)
+
+#if DSP_HAS_MINIM_ENGINE
+#include "Line.h"
+#include "Multiplier.h"
+#include "Constant.h"
+#include "TickRate.h"
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+#define DSP_NULLTEST_TOLERANCE 1e-4
+#endif
+
+// the rate is heard on a log scale, so the block graph glides it exponentially. the null test glides
+// it linearly instead, like the Minim graph's Line, so that the two can be compared.
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+#define DSP_RATE_SMOOTHING block::smoothing::linear
+#else
+#define DSP_RATE_SMOOTHING block::smoothing::exponential
+#endif
+
+// the block graph is rendered this many frames at a time, one node after the other,
+// so that the scratch buffers passed between nodes stay small enough to live in cache.
+#define DSP_BLOCK_SIZE 64
+
+// how many notes the block graph can play at once. every voice is allocated up front and,
+// when they are all in use, a new note takes over the quietest released voice or else the oldest held one.
+// with a single voice the block graph plays legato like the Minim graph, which the null test relies on.
+#ifndef DSP_VOICE_COUNT
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+#define DSP_VOICE_COUNT 1
+#else
+#define DSP_VOICE_COUNT 8
+#endif
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST && DSP_VOICE_COUNT != 1
+#error "the null test compares against the monophonic Minim graph and needs DSP_VOICE_COUNT to be 1"
+#endif
+
+// the highest factor the waveshaper can be oversampled by, which sizes the oversampled scratch buffers
+#define DSP_MAX_OVERSAMPLING 8
+
+// how long it takes, in seconds, to crossfade from the old wavetable to a newly loaded one
+#define DSP_WAVETABLE_FADE_TIME 0.005
+
+// the precision the plugin's block graph renders at. WaveShaperDSP is compiled for both float, which
+// fits twice as many frames in every vector, and double, for mastering-grade renders. the Minim graph
+// and the host buffers are unaffected, the graph is converted to the host's precision as it is output.
+#ifndef DSP_PRECISION
+#define DSP_PRECISION float
+#endif
 
 using namespace iplug;
 
+#if DSP_HAS_MINIM_ENGINE
+// an Envelope patched into a Minim chain, scaling the audio that goes through it
 class ADSR : public Minim::UGen
 {
 public:
 	ADSR();
 
-	bool isOn() const { return mState == kAttack || mState == kDecay || mState == kSustain; }
+	bool isOn() const { return mEnvelope.isOn(); }
 
 	void noteOn(float amp, float attack, float decay, float sustain, float release);
-	void noteOff();
+	void noteOff() { mEnvelope.noteOff(); }
 
-	// jump right to the Off state and set mAmp to 0. unpatch if patched.
-	void stop();
-	float getRelease() const { return mRelease; }
+	// used from the next segment on
+	void setCurve(Envelope::Curve curve) { mEnvelope.setCurve(curve); }
+	float getRelease() const { return mEnvelope.getRelease(); }
+	// the amplitude the last sample was scaled by
+	float getLevel() const { return mEnvelope.getLevel(); }
 
 	UGenInput audio;
 
 protected:
 	virtual void uGenerate(float * channels, const int numChannels) override;
 
-	virtual void sampleRateChanged() override;
-
 private:
-
-	enum
-	{
-		kOff,
-		kAttack,
-		kDecay,
-		kSustain,
-		kRelease
-	} mState;
-
-	bool mAutoRelease;
-	float mAmp, mAttack, mDecay, mSustain, mRelease;
-	float mTime, mStep;
+	Envelope mEnvelope;
 };
+#endif
 
 namespace Minim
 {
@@ -62,8 +117,7 @@ namespace Minim
   class MultiChannelBuffer;
 }
 
-typedef std::vector<IMidiMsg> MidiMsgList;
-
+template<typename T>
 class WaveShaperDSP
 {
 public:
@@ -73,73 +127,176 @@ public:
 
   void ProcessBlock(sample** inputs, sample** outputs, int nOutputs, int nFrames);
 
-  void Reset(double sampleRate, int blockSize)
-  {
-    mMidiQueue.Clear();
-    mMidiQueue.Resize(blockSize);
-    mMainSignalVol.setSampleRate((float)sampleRate);
-    mSignalDT = 1.0 / sampleRate;
-  }
+  void Reset(double sampleRate, int blockSize);
 
   void ProcessMidiMsg(const IMidiMsg& msg)
   {
     mMidiQueue.Add(msg);
   }
 
-  void SetWavetables(Minim::MultiChannelBuffer& buffer);
+  // the sample is played from where it is in the cache, it is not copied
+  void SetWavetables(const SampleCache::Handle& source);
+  // UI thread: lets go of the samples that have finished fading out
+  void FreeUnusedWavetables();
 
-  void SetVolume(double value) { mVolume = value; }
+  void SetVolume(double value) { mVolume = value; TriggerVolumeChange(value, 0.02); }
   void SetAttack(double value) { mAttack = value; }
   void SetDecay(double value) { mDecay = value; }
   void SetSustain(double value) { mSustain = value; }
   void SetRelease(double value) { mRelease = value; }
   void SetNoiseTint(Minim::Noise::Tint value) { mNoiseTint = value; }
   void SetNoiseMod(double value) { mMod = value; TriggerModChange(value, 0.01); }
-  void SetNoiseRate(double value) { mRate = value; if (!mMidiNotes.empty()) TriggerRateChange(value, 0.01); }
+  void SetNoiseRate(double value);
   void SetNoiseRange(double value) { mRange = value; TriggerRangeChange(value, 0.1); }
   void SetNoiseShape(double value) { mShape = value; TriggerShapeChange(value, 0.1); }
+  // factor of 1, 2, 4 or 8 the waveshaper runs at relative to the host rate, applied at the start of the next block
+  void SetOversampling(int factor) { mOversamplingRequest = factor; }
+  void SetInterpolation(block::shaperInterpolation::type value);
+  // shape of the envelope segments, used from the next segment each voice starts
+  void SetEnvelopeCurve(Envelope::Curve value);
+
+  // frames the output is delayed by, rounded to the nearest, which the plugin reports to the host
+  int GetLatency() const;
 
+#if DSP_HAS_MINIM_ENGINE
   float GetNoiseOffset() const { return mNoizeOffset->value.getLastValue(); }
   float GetNoiseRate() const { return mNoizeRate->getLastValues()[0]; }
   float GetShape() const { return mShapeCtrl.getLastValues()[0]; }
+#else
+  float GetNoiseOffset() const { return (float)vRangeCtrl.getValue(); }
+  float GetNoiseRate() const { return (float)mVoices[mNewestVoice].rate.getValue(); }
+  float GetShape() const { return (float)vShapeCtrl.getValue(); }
+#endif
   int   GetShaperSize() const { return mShaperSize; }
   float GetShaperMapValue() const { return mShaperMapValue; }
 
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  // how far the block graph has strayed from the Minim graph since the last Reset, path by path.
+  // the two graphs draw their noise from different generators, so the noise itself is only compared
+  // by its level, the root mean square of every frame a voice played with each tint.
+  struct NullTestReport
+  {
+    enum Path
+    {
+      kRate,
+      kMod,
+      kRange,
+      kEnvelope,
+      // the noise scaled by the mod and offset by the range
+      kScrub,
+      // the Minim scrub looked up by the block shaper, scaled by the envelope and volume
+      kOutput,
+      kPathCount
+    };
+
+    static const char* PathName(int path);
+
+    // largest difference seen on each path, and the first frame it was seen at
+    double maxError[kPathCount];
+    long long maxErrorFrame[kPathCount];
+    // sums of the squares of the noise played with each tint, and how many frames went into them
+    double minimNoise[3];
+    double blockNoise[3];
+    long long noiseFrames[3];
+  };
+
+  const NullTestReport& GetNullTestReport() const { return mNullReport; }
+#endif
+
 private:
-  void TriggerModChange(sample target, sample duration)
+  void HandleMidiMsg(const IMidiMsg& msg);
+
+  // renders nFrames into outputs starting at offset. there are no MIDI events inside of a span,
+  // so the whole thing is rendered in one go, DSP_BLOCK_SIZE frames at a time for the block graph.
+  void RenderSpan(sample** outputs, int nOutputs, int offset, int nFrames);
+
+  // copies nFrames of stereo into the first nOutputs outputs starting at offset, a channel at a time.
+  // a single output gets both sides mixed together, and past the first two the outputs alternate
+  // between left and right. this is where the graph's precision is converted to the host's.
+  template<typename U>
+  void WriteOutputs(sample** outputs, int nOutputs, int offset, const U* left, const U* right, int nFrames);
+
+#if DSP_HAS_MINIM_ENGINE
+  // ticks the Minim graph once per frame of the span
+  void RenderMinimSpan(sample** outputs, int nOutputs, int offset, int nFrames);
+#endif
+
+#if DSP_HAS_BLOCK_ENGINE
+  struct Voice;
+
+  void NoteOn(const IMidiMsg& msg);
+  void NoteOff(const IMidiMsg& msg);
+  // picks the voice a new note is played on, stealing one if they are all in use
+  Voice& AllocateVoice();
+  void ReleaseVoice(Voice& voice);
+
+  // renders nFrames (at most DSP_BLOCK_SIZE) of the block graph, one node at a time
+  void RenderBlock(T* outLeft, T* outRight, int nFrames);
+  // adds nFrames of a single voice, scaled by its envelope, to outLeft and outRight at the oversampled rate,
+  // so they need room for nFrames * mOversampling. when fading, the previous wavetable is mixed in using mBlockFade.
+  void RenderVoice(Voice& voice, T* outLeft, T* outRight, int nFrames, bool fading);
+  // looks up nFrames of scrub in the two levels of table either side of level and blends between them
+  void RenderLookup(block::waveshaper<T>& shaper, const typename WavetableStore<T>::Table* table, T level,
+                    const T* scrub, T* outLeft, T* outRight, int nFrames);
+  // fills mBlockEnvUp with the nFrames of envelope in mBlockEnv at the oversampled rate, delayed by as much as the
+  // voice's scrub is delayed by its upsampler so that the two line up again
+  void DelayEnvelope(Voice& voice, int nFrames);
+
+  // clears the oversampling filters and switches them over to mOversamplingRequest
+  void UpdateOversampling();
+
+  // switches the shaper over to the current wavetable, fading out the previous one
+  void BeginWavetableFade();
+
+  // true once nothing has sounded for long enough that the output is nothing but zeros
+  bool IsIdle() const { return mFadeRemaining == 0 && mSilentFrames >= kIdleTail; }
+  // moves the shared controls on by nFrames without rendering anything, so that they are
+  // where they would have been when the next note starts
+  void SkipBlock(int nFrames);
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  // compares nFrames of the last rendered block against what the Minim graph recorded starting at offset
+  void NullTest(int offset, int nFrames);
+#endif
+
+  // every continuous parameter is smoothed, in the Minim graph by a Line and in the block graph by a smoother.
+  // the Minim graph sets its volume every frame, so only the block graph smooths it.
+  void TriggerVolumeChange(double target, double duration)
   {
-    mModCtrl.activate(duration, mModCtrl.getAmp(), target);
-    vModCtrl.begin = vModCtrl.value;
-    vModCtrl.end = target;
-    vModCtrl.duration = duration;
-    vModCtrl.trigger();
+#if DSP_HAS_BLOCK_ENGINE
+    vVolumeCtrl.rampTo((T)target, (T)duration);
+#endif
   }
 
-  void TriggerRateChange(sample target, sample duration)
+  void TriggerModChange(double target, double duration)
   {
-    mRateCtrl.activate(duration, mRateCtrl.getAmp(), target);
-    vRateCtrl.begin = vRateCtrl.value;
-    vRateCtrl.end = target;
-    vRateCtrl.duration = duration;
-    vRateCtrl.trigger();
+#if DSP_HAS_MINIM_ENGINE
+    mModCtrl.activate(duration, mModCtrl.getAmp(), target);
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+    vModCtrl.rampTo((T)target, (T)duration);
+#endif
   }
 
-  void TriggerRangeChange(sample target, sample duration)
+  void TriggerRangeChange(double target, double duration)
   {
+#if DSP_HAS_MINIM_ENGINE
     mRangeCtrl.activate(duration, mRangeCtrl.getAmp(), target);
-    vRangeCtrl.begin = vRangeCtrl.value;
-    vRangeCtrl.end = target;
-    vRangeCtrl.duration = duration;
-    vRangeCtrl.trigger();
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+    vRangeCtrl.rampTo((T)target, (T)duration);
+#endif
   }
 
-  void TriggerShapeChange(sample target, sample duration)
+  void TriggerShapeChange(double target, double duration)
   {
+#if DSP_HAS_MINIM_ENGINE
     mShapeCtrl.activate(duration, mShapeCtrl.getAmp(), target);
-    vShapeCtrl.begin = vShapeCtrl.value;
-    vShapeCtrl.end = target;
-    vShapeCtrl.duration = duration;
-    vShapeCtrl.trigger();
+#endif
+#if DSP_HAS_BLOCK_ENGINE
+    vShapeCtrl.rampTo((T)target, (T)duration);
+#endif
   }
 
   // params
@@ -148,11 +305,13 @@ private:
   int mShaperSize;
   float mShaperMapValue;
   double mSignalDT;
+  int mOversamplingRequest;
 
   IMidiQueue  mMidiQueue;
-  MidiMsgList mMidiNotes;
+  NoteStack   mMidiNotes;
   Minim::Noise::Tint mNoiseTint;
 
+#if DSP_HAS_MINIM_ENGINE
   Minim::Noise	     * mNoize;
   Minim::TickRate	   * mNoizeRate;
   Minim::Multiplier  * mNoizeAmp;
@@ -166,6 +325,9 @@ private:
   Minim::Summer	     * mMainSignal;
 
   Minim::Multiplier  mMainSignalVol;
+  // what the graph rendered for each frame of the current ProcessBlock
+  std::vector<float> mMinimLeft;
+  std::vector<float> mMinimRight;
 
   // controls
   Minim::Line	mRateCtrl;
@@ -173,24 +335,108 @@ private:
   Minim::Line	mRangeCtrl;
   Minim::Line mShapeCtrl;
   ADSR				mEnvelope;
+#endif
 
-  // vessl version
-  vessl::samplebuffer<sample, BUFFER_SIZE> mBufferLeft;
-  vessl::samplebuffer<sample, BUFFER_SIZE> mBufferRight;
-
-  vessl::noise<sample> vNoize;
-  vessl::multiplier<sample> vNoizeAmp;
-  vessl::oscil<sample> vNoizeMod;
-  vessl::multiplier<sample> vNoizeModAmp;
-  vessl::summer<sample, 2> vNoizeSum;
-  vessl::waveshaper<sample> vNoizeShaperLeft;
-  vessl::waveshaper<sample> vNoizeShaperRight;
-  vessl::mixer<sample, 2, 2> vNoizeShaperMixer;
-
-  vessl::ramp<sample> vRateCtrl;
-  vessl::ramp<sample> vModCtrl;
-  vessl::ramp<sample> vRangeCtrl;
-  vessl::ramp<sample> vShapeCtrl;
-
-  vessl::signal<sample> vMainSignal;
+#if DSP_HAS_BLOCK_ENGINE
+  // everything a single note needs to render, kept in one place so that a voice's state
+  // is contiguous in memory and the voices are too. the mod, range and shape are shared.
+  struct Voice
+  {
+    Voice() : noise(block::noiseTint::pink), rate(0, DSP_RATE_SMOOTHING), note(kNoNote), age(0) {}
+
+    enum { kNoNote = -1 };
+    // enough frames to cover the upsampler's delay at every factor, which is longest at 8x
+    enum { kEnvHistory = 11 };
+
+    Envelope envelope;
+    block::noise<T> noise;
+    block::smoother<T> rate;
+    block::upsampler<T> scrubUp;
+    // the end of the envelope's previous block, which DelayEnvelope reaches back into
+    T envHistory[kEnvHistory];
+    // normalized position in the wavetable the voice last read from
+    T position;
+    // last scrub value of the previous block, for measuring how fast the scrub is moving
+    T lastScrub;
+    // channel * 128 + note number of the key holding this voice, kNoNote once it has been released
+    int note;
+    // value of mVoiceClock when the voice was last triggered
+    unsigned age;
+  };
+
+  // block version
+  WavetableStore<T> mWavetables;
+  int mFadeLength;
+  int mFadeRemaining;
+  int mOversampling;
+
+  // the oversampling filters are still emptying for a few frames after the last voice stops,
+  // this is comfortably longer than the longest of them
+  enum { kIdleTail = DSP_BLOCK_SIZE };
+  // frames rendered since the last voice stopped sounding
+  int mSilentFrames;
+
+  Voice mVoices[DSP_VOICE_COUNT];
+  int mNewestVoice;
+  unsigned mVoiceClock;
+
+  block::oscil<T> vNoizeMod;
+  // both are pointed at whichever wavetable level each lookup reads from
+  block::waveshaper<T> vNoizeShaper;
+  // reads the previous wavetable while it is faded out
+  block::waveshaper<T> vFadeShaper;
+
+  block::smoother<T> vModCtrl;
+  block::smoother<T> vRangeCtrl;
+  block::smoother<T> vShapeCtrl;
+  block::smoother<T> vVolumeCtrl;
+  // brings the oversampled mix of all voices back to the host rate
+  block::downsampler<T> vMixDownLeft;
+  block::downsampler<T> vMixDownRight;
+
+  // scratch buffers passed from node to node by RenderBlock
+  T mBlockRate[DSP_BLOCK_SIZE];
+  T mBlockMod[DSP_BLOCK_SIZE];
+  T mBlockRange[DSP_BLOCK_SIZE];
+  T mBlockShape[DSP_BLOCK_SIZE];
+  T mBlockEnv[DSP_BLOCK_SIZE];
+  T mBlockVolume[DSP_BLOCK_SIZE];
+  T mBlockScrub[DSP_BLOCK_SIZE];
+  // how much of the previous wavetable each frame still hears, shared by all voices
+  T mBlockFade[DSP_BLOCK_SIZE];
+  T mBlockOutLeft[DSP_BLOCK_SIZE];
+  T mBlockOutRight[DSP_BLOCK_SIZE];
+  // everything from the waveshaper lookup up to the mix runs at the oversampled rate
+  T mBlockScrubUp[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockEnvUp[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  // a voice's envelope history followed by its current block, see DelayEnvelope
+  T mBlockEnvDelay[Voice::kEnvHistory + DSP_BLOCK_SIZE];
+  T mBlockLeft[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockRight[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockFadeLeft[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockFadeRight[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  // the more band-limited of the two wavetable levels being blended
+  T mBlockMipLeft[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockMipRight[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  // sum of every voice
+  T mBlockMixLeft[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+  T mBlockMixRight[DSP_BLOCK_SIZE * DSP_MAX_OVERSAMPLING];
+#endif
+
+#if DSP_ENGINE == DSP_ENGINE_NULLTEST
+  // what the Minim graph produced for each frame of the current ProcessBlock
+  std::vector<float> mNullRate;
+  std::vector<float> mNullNoise;
+  std::vector<float> mNullScrub;
+  std::vector<float> mNullMod;
+  std::vector<float> mNullRange;
+  std::vector<float> mNullEnv;
+  // the noise the block voice rendered, before the mod and range, see RenderVoice
+  T mBlockNoise[DSP_BLOCK_SIZE];
+  // whether the block voice rendered anything in the last block, the rate and noise are only compared when it did
+  bool mNullVoiceRendered;
+  // frames compared since the last Reset
+  long long mNullFrame;
+  NullTestReport mNullReport;
+#endif
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+// Floating point values that decay towards zero, like the tail of a release or the state of a
+// lowpass with nothing going into it, eventually become denormal, which on x86 are handled so
+// slowly that a voice fading out can cost many times what it did while it was playing.
+// ScopedFlushDenormals sets the CPU to treat them as zero for as long as it is in scope and then
+// puts back whatever was set before, so it can wrap any code that renders audio on any thread.
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DENORMALS_SSE 1
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define DENORMALS_AARCH64 1
+#endif
+
+class ScopedFlushDenormals
+{
+public:
+  // does nothing when flush is false
+  explicit ScopedFlushDenormals(bool flush = true)
+    : mFlush(flush)
+  {
+    if (!mFlush)
+    {
+      return;
+    }
+
+#if DENORMALS_SSE
+    // flush to zero and denormals are zero
+    mSaved = _mm_getcsr();
+    _mm_setcsr(mSaved | 0x8040);
+#elif DENORMALS_AARCH64
+    // flush to zero, which on ARM covers both inputs and outputs
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(mSaved));
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(mSaved | (1ull << 24)));
+#endif
+  }
+
+  ~ScopedFlushDenormals()
+  {
+    if (!mFlush)
+    {
+      return;
+    }
+
+#if DENORMALS_SSE
+    _mm_setcsr(mSaved);
+#elif DENORMALS_AARCH64
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(mSaved));
+#endif
+  }
+
+  ScopedFlushDenormals(const ScopedFlushDenormals&) = delete;
+  ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+private:
+  bool mFlush;
+#if DENORMALS_SSE
+  unsigned int mSaved;
+#elif DENORMALS_AARCH64
+  unsigned long long mSaved;
+#endif
+};
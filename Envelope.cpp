@@ -0,0 +1,199 @@
+#include "Envelope.h"
+
+#include <algorithm>
+#include <cmath>
+
+Envelope::Envelope()
+	: mState(kOff)
+	, mCurve(kLinear)
+	, mSegmentCurve(kLinear)
+	, mAutoRelease(false)
+	, mSampleRate(44100)
+	, mAmp(0)
+	, mAttack(0)
+	, mDecay(0)
+	, mSustain(0)
+	, mRelease(0)
+	, mLevel(0)
+	, mTarget(0)
+	, mIncrement(0)
+	, mRemaining(0)
+	, mLastLevel(0)
+{
+}
+
+void Envelope::noteOn(float amp, float attack, float decay, float sustain, float release)
+{
+	mAmp = amp;
+	mAttack = attack;
+	mDecay = decay;
+	mSustain = sustain;
+	mRelease = release;
+	mAutoRelease = false;
+
+	if (mAttack > 0)
+	{
+		beginSegment(kAttack, mAmp, mAttack);
+	}
+	else if (mDecay > 0)
+	{
+		mLevel = mAmp;
+		beginSegment(kDecay, mAmp*mSustain, mDecay);
+	}
+	else
+	{
+		mLevel = mAmp*mSustain;
+		beginSustain();
+	}
+}
+
+void Envelope::noteOff()
+{
+	if (mState == kSustain)
+	{
+		beginSegment(kRelease, 0, mRelease);
+	}
+	else
+	{
+		mAutoRelease = true;
+	}
+}
+
+void Envelope::stop()
+{
+	mState = kOff;
+	mAmp = 0;
+	mLevel = 0;
+	mLastLevel = 0;
+}
+
+template<typename T>
+void Envelope::render(T* out, const int nFrames)
+{
+	int s = 0;
+	while (s < nFrames)
+	{
+		if (mState == kOff || mState == kSustain)
+		{
+			// when we are off, the level is zero, so both just hold where they are until a note changes them
+			const T level = (T)mLevel;
+			for (; s < nFrames; ++s)
+			{
+				out[s] = level;
+			}
+			break;
+		}
+
+		const int frames = mRemaining < nFrames - s ? mRemaining : nFrames - s;
+		fillSegment(out + s, frames);
+		s += frames;
+		mRemaining -= frames;
+		if (mRemaining == 0)
+		{
+			endSegment();
+		}
+	}
+
+	if (nFrames > 0)
+	{
+		mLastLevel = (float)out[nFrames - 1];
+	}
+}
+
+void Envelope::beginSegment(State state, double target, float duration)
+{
+	mState = state;
+	mTarget = target;
+	mSegmentCurve = mCurve;
+	mRemaining = std::max(1, (int)std::ceil(duration * mSampleRate));
+
+	if (mSegmentCurve == kExponential)
+	{
+		// ln(0.001)
+		mIncrement = std::exp(-6.907755278982137 / mRemaining);
+	}
+	else
+	{
+		mIncrement = (mTarget - mLevel) / mRemaining;
+	}
+}
+
+void Envelope::endSegment()
+{
+	mLevel = mTarget;
+	switch (mState)
+	{
+	case kAttack:
+		if (mDecay > 0)
+		{
+			beginSegment(kDecay, mAmp*mSustain, mDecay);
+		}
+		else
+		{
+			mLevel = mAmp*mSustain;
+			beginSustain();
+		}
+		break;
+
+	case kDecay:
+		beginSustain();
+		break;
+
+	case kRelease:
+		mLevel = 0;
+		mState = kOff;
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Envelope::beginSustain()
+{
+	mState = kSustain;
+	if (mAutoRelease)
+	{
+		beginSegment(kRelease, 0, mRelease);
+	}
+}
+
+template<typename T>
+void Envelope::fillSegment(T* out, const int nFrames)
+{
+	if (mSegmentCurve == kLinear)
+	{
+		// every sample is worked out from the start of the span, so the loop vectorizes
+		for (int s = 0; s < nFrames; ++s)
+		{
+			out[s] = (T)(mLevel + mIncrement * s);
+		}
+		mLevel += mIncrement * nFrames;
+		return;
+	}
+
+	// the distance to the target shrinks by the same ratio every sample,
+	// so four samples at a time are worked out from powers of it
+	const double r2 = mIncrement * mIncrement;
+	const double powers[4] = { 1, mIncrement, r2, r2 * mIncrement };
+	const double r4 = r2 * r2;
+	double distance = mLevel - mTarget;
+	int s = 0;
+	for (; s + 4 <= nFrames; s += 4)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			out[s + k] = (T)(mTarget + distance * powers[k]);
+		}
+		distance *= r4;
+	}
+	for (; s < nFrames; ++s)
+	{
+		out[s] = (T)(mTarget + distance);
+		distance *= mIncrement;
+	}
+	mLevel = mTarget + distance;
+}
+
+template void Envelope::render(float* out, const int nFrames);
+template void Envelope::render(double* out, const int nFrames);
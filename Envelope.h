@@ -0,0 +1,76 @@
+#pragma once
+
+// An attack, decay, sustain, release envelope that renders a block of levels at a time.
+// It is plain state with no graph behind it, so the block graph keeps one inside each voice,
+// and the Minim graph wraps one in the ADSR UGen.
+class Envelope
+{
+public:
+	enum Curve
+	{
+		kLinear,
+		// each segment closes in on its target like a one-pole filter, getting 60dB of the way there before snapping to it
+		kExponential
+	};
+
+	Envelope();
+
+	// the rate segment durations are converted at, used from the next segment on
+	void setSampleRate(float sampleRate) { mSampleRate = sampleRate; }
+
+	bool isOn() const { return mState == kAttack || mState == kDecay || mState == kSustain; }
+	bool isSounding() const { return mState != kOff; }
+	// the amplitude of the last sample generated
+	float getLevel() const { return mLastLevel; }
+
+	// the attack starts from wherever the envelope is, so a note that retriggers it while it is
+	// still sounding rises from its level instead of jumping to silence and clicking
+	void noteOn(float amp, float attack, float decay, float sustain, float release);
+	void noteOff();
+
+	// used from the next segment on
+	void setCurve(Curve curve) { mCurve = curve; }
+
+	// fills out with the amplitude of the envelope for the next nFrames samples.
+	// each segment is filled in one go, up to the sample it ends on, so a block only goes through
+	// the state machine when a segment starts or ends inside of it.
+	template<typename T>
+	void render(T* out, const int nFrames);
+
+	// jump right to the Off state and set the level to 0
+	void stop();
+	float getRelease() const { return mRelease; }
+
+private:
+	enum State
+	{
+		kOff,
+		kAttack,
+		kDecay,
+		kSustain,
+		kRelease
+	};
+
+	// starts a segment that goes from the current level to target in duration seconds
+	void beginSegment(State state, double target, float duration);
+	// moves on to whatever comes after the segment that just finished
+	void endSegment();
+	void beginSustain();
+	// fills nFrames of the current segment, which has at least that many left
+	template<typename T>
+	void fillSegment(T* out, const int nFrames);
+
+	State mState;
+	Curve mCurve, mSegmentCurve;
+
+	bool mAutoRelease;
+	float mSampleRate;
+	float mAmp, mAttack, mDecay, mSustain, mRelease;
+	// the level of the next sample and the level the current segment ends on
+	double mLevel, mTarget;
+	// added to the level every sample in a linear segment, otherwise what the distance to the target is multiplied by
+	double mIncrement;
+	// samples left in the current segment
+	int mRemaining;
+	float mLastLevel;
+};
@@ -1,8 +1,17 @@
 #include "IPlugPlatform.h"
 #include "FileLoader.h"
+#include "config.h"
+
+#include <cstdint>
+#include <cstring>
 
 #ifdef OS_WIN
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 // implements sf_virutal_io to allow us to use libsndfile to load wave files included as resources
@@ -61,25 +70,175 @@ struct ResourceFile
 	}
 };
 
-FileLoader::FileLoader()
-	: mBuffer(nullptr)
+// frames decoded at a time. small enough for the scratch buffer to stay in cache while it is deinterleaved.
+static const int kChunkFrames = 4096;
+
+// maps a whole file into memory for reading
+struct MappedFile
+{
+	const unsigned char * data;
+	size_t size;
+
+	MappedFile(const char * fileName)
+		: data(nullptr)
+		, size(0)
+	{
+#ifdef OS_WIN
+		mapping = NULL;
+		file = ::CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		LARGE_INTEGER fileSize;
+		if (file == INVALID_HANDLE_VALUE || !::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			return;
+		}
+
+		mapping = ::CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			data = static_cast<const unsigned char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			size = data != nullptr ? static_cast<size_t>(fileSize.QuadPart) : 0;
+		}
+#else
+		descriptor = open(fileName, O_RDONLY);
+		struct stat info;
+		if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0)
+		{
+			return;
+		}
+
+		void * mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (mapped != MAP_FAILED)
+		{
+			// it is read from front to back once
+			madvise(mapped, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+			data = static_cast<const unsigned char*>(mapped);
+			size = static_cast<size_t>(info.st_size);
+		}
+#endif
+	}
+
+	~MappedFile()
+	{
+#ifdef OS_WIN
+		if (data != nullptr) ::UnmapViewOfFile(data);
+		if (mapping != NULL) ::CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) ::CloseHandle(file);
+#else
+		if (data != nullptr) munmap(const_cast<unsigned char*>(data), size);
+		if (descriptor >= 0) close(descriptor);
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+#ifdef OS_WIN
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int descriptor;
+#endif
+};
+
+// the values the samples of a WAV file are stored as that ReadWave converts itself
+enum WaveEncoding
+{
+	kWaveUnsupported,
+	kWaveInt8,
+	kWaveInt16,
+	kWaveInt24,
+	kWaveInt32,
+	kWaveFloat32,
+	kWaveFloat64,
+};
+
+static uint16_t ReadU16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t ReadU32(const unsigned char* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+// the same scaling libsndfile uses, so a file sounds the same whichever way it was read
+static float DecodeInt8(const unsigned char* p) { return (p[0] - 128) / 128.f; }
+static float DecodeInt16(const unsigned char* p) { return (int16_t)ReadU16(p) / 32768.f; }
+static float DecodeInt24(const unsigned char* p) { return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) / 2147483648.f; }
+static float DecodeInt32(const unsigned char* p) { return (int32_t)ReadU32(p) / 2147483648.f; }
+static float DecodeFloat32(const unsigned char* p) { float value; memcpy(&value, p, sizeof(value)); return value; }
+static float DecodeFloat64(const unsigned char* p) { double value; memcpy(&value, p, sizeof(value)); return (float)value; }
+
+// converts count interleaved frames, each frameBytes long, into the channels of outBuffer starting at offset
+template<float (*Decode)(const unsigned char*)>
+static void DeinterleaveWave(const unsigned char* frames, int frameBytes, int sampleBytes, int count, Minim::MultiChannelBuffer& outBuffer, int offset)
+{
+	for (int c = 0; c < outBuffer.getChannelCount(); ++c)
+	{
+		const unsigned char * in = frames + c * sampleBytes;
+		float * channel = outBuffer.getChannel(c) + offset;
+		for (int i = 0; i < count; ++i)
+		{
+			channel[i] = Decode(in + i * frameBytes);
+		}
+	}
+}
+
+// the audio files built into the plugin, as the bytes of the files themselves, so that they load the same way
+// on every platform. the .inc files are made from the audio files by scripts/embed_sample.py.
+static const unsigned char kSound01[] =
+{
+#include "resources/snd/BadBassAmp.wav.inc"
+};
+
+struct EmbeddedResource
+{
+	int id;
+	const unsigned char * data;
+	size_t size;
+};
+
+static const EmbeddedResource kEmbeddedResources[] =
+{
+	{ SND_01_ID, kSound01, sizeof(kSound01) },
+};
+
+FileLoader::FileLoader(int maxFrames)
+	: mMaxFrames(maxFrames)
+	, mBuffer(nullptr)
 	, mBufferSize(0)
 {
 
 }
 
-void FileLoader::Load(int resourceID, const char * resourceName, Minim::MultiChannelBuffer& outBuffer)
+FileLoader::~FileLoader()
 {
-#ifdef OS_WIN
-	HRSRC myResource = ::FindResource(NULL, MAKEINTRESOURCE(resourceID), "WAVE");
-	unsigned int myResourceSize = ::SizeofResource(NULL, myResource);
-	HGLOBAL myResourceData = ::LoadResource(NULL, myResource);
-	void* pMyBinaryData = ::LockResource(myResourceData);
+	delete[] mBuffer;
+}
+
+int FileLoader::Load(int resourceID, Minim::MultiChannelBuffer& outBuffer, const Progress& progress)
+{
+	const EmbeddedResource * resource = nullptr;
+	for (const EmbeddedResource& embedded : kEmbeddedResources)
+	{
+		if (embedded.id == resourceID)
+		{
+			resource = &embedded;
+		}
+	}
+
+	if (resource == nullptr)
+	{
+		return 0;
+	}
 
+	// a WAV resource is read straight from where it sits in the binary
+	int sampleRate = 0;
+	if (ReadWave(resource->data, resource->size, outBuffer, progress, sampleRate))
+	{
+		return sampleRate;
+	}
+
+	// anything else is handed to libsndfile, which reads it in place as well
 	ResourceFile resFile;
-	resFile.data = static_cast<const char*>(pMyBinaryData);
+	resFile.data = reinterpret_cast<const char*>(resource->data);
 	resFile.position = 0;
-	resFile.size = myResourceSize;
+	resFile.size = resource->size;
 
 	SF_VIRTUAL_IO io;
 	io.get_filelen = &ResourceFile::getLength;
@@ -93,56 +252,229 @@ void FileLoader::Load(int resourceID, const char * resourceName, Minim::MultiCha
 
 	if (file != NULL)
 	{
-		ReadFile(fileInfo, file, outBuffer);
+		ReadFile(fileInfo, file, outBuffer, progress);
+		sampleRate = fileInfo.samplerate;
 	}
 
 	sf_close(file);
-
-	::FreeResource(myResourceData);
-#else
-#endif
+	return sampleRate;
 }
 
-void FileLoader::Load(const char * fileName, Minim::MultiChannelBuffer& outBuffer)
+int FileLoader::Load(const char * fileName, Minim::MultiChannelBuffer& outBuffer, const Progress& progress)
 {
+	int sampleRate = 0;
+	{
+		MappedFile mapped(fileName);
+		if (mapped.data != nullptr && ReadWave(mapped.data, mapped.size, outBuffer, progress, sampleRate))
+		{
+			return sampleRate;
+		}
+	}
+
 	SF_INFO fileInfo;
 	fileInfo.format = 0;
 	SNDFILE* file = sf_open(fileName, SFM_READ, &fileInfo);
 
 	if ( file != NULL )
 	{
-		ReadFile(fileInfo, file, outBuffer);
+		ReadFile(fileInfo, file, outBuffer, progress);
+		sampleRate = fileInfo.samplerate;
 	}
 
 	sf_close(file);
+	return sampleRate;
 }
 
-void FileLoader::ReadFile(SF_INFO& fileInfo, SNDFILE* file, Minim::MultiChannelBuffer& outBuffer)
+
+void FileLoader::ReadFile(SF_INFO& fileInfo, SNDFILE* file, Minim::MultiChannelBuffer& outBuffer, const Progress& progress)
 {
-	const sf_count_t fileSize = fileInfo.channels*fileInfo.frames;
-	if (mBufferSize < fileSize)
+	const int channels = fileInfo.channels;
+	const sf_count_t frames = fileInfo.frames < mMaxFrames ? fileInfo.frames : mMaxFrames;
+	const size_t chunkSize = (size_t)channels * kChunkFrames;
+	if (mBufferSize < chunkSize)
+	{
+		delete[] mBuffer;
+		mBuffer = new float[chunkSize];
+		mBufferSize = chunkSize;
+	}
+
+	// size the buffer to the file, so short samples stay small and long ones aren't truncated
+	outBuffer.setChannelCount(channels);
+	outBuffer.setBufferSize((int)frames);
+
+	sf_count_t framesRead = 0;
+	while (framesRead < frames)
 	{
-		if (mBuffer != nullptr)
+		const sf_count_t chunkFrames = frames - framesRead < kChunkFrames ? frames - framesRead : kChunkFrames;
+		const sf_count_t read = sf_readf_float(file, mBuffer, chunkFrames);
+		if (read <= 0)
 		{
-			delete[] mBuffer;
+			break;
+		}
+
+		// deinterleave the chunk straight into the channels
+		const int count = (int)read;
+		switch (channels)
+		{
+			case 1:
+				memcpy(outBuffer.getChannel(0) + framesRead, mBuffer, count * sizeof(float));
+				break;
+
+			case 2:
+			{
+				float * left = outBuffer.getChannel(0) + framesRead;
+				float * right = outBuffer.getChannel(1) + framesRead;
+				for (int i = 0; i < count; ++i)
+				{
+					left[i] = mBuffer[i * 2];
+					right[i] = mBuffer[i * 2 + 1];
+				}
+			}
+			break;
+
+			default:
+				for (int c = 0; c < channels; ++c)
+				{
+					float * channel = outBuffer.getChannel(c) + framesRead;
+					for (int i = 0; i < count; ++i)
+					{
+						channel[i] = mBuffer[i * channels + c];
+					}
+				}
+				break;
+		}
+		framesRead += read;
+
+		if (progress && !progress((float)framesRead / frames))
+		{
+			outBuffer.setBufferSize(0);
+			return;
 		}
-		mBuffer = new float[fileSize];
 	}
-	// read in the whole thing
-	sf_count_t framesRead = sf_readf_float(file, mBuffer, fileInfo.frames);
 
-	outBuffer.setChannelCount(fileInfo.channels);
-  outBuffer.makeSilence();
-  sf_count_t toWrite = framesRead < outBuffer.getBufferSize() ? framesRead : outBuffer.getBufferSize();
-	// and now we should be able to de-interleave our read buffer into buffer
-	for (int c = 0; c < fileInfo.channels; ++c)
+	// a file that turns out to be shorter than its header said is padded with silence
+	if (framesRead < frames)
 	{
-		float * channel = outBuffer.getChannel(c);
-		for (int i = 0; i < toWrite; ++i)
+		for (int c = 0; c < channels; ++c)
 		{
-			const int offset = (i * fileInfo.channels) + c;
-			const float sample = mBuffer[offset];
-			channel[i] = sample;
+			memset(outBuffer.getChannel(c) + framesRead, 0, (size_t)(frames - framesRead) * sizeof(float));
 		}
 	}
 }
+
+bool FileLoader::ReadWave(const unsigned char* data, size_t size, Minim::MultiChannelBuffer& outBuffer, const Progress& progress, int& sampleRate)
+{
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+	{
+		return false;
+	}
+
+	// walk the chunks for the format and the frames, which can come in any order with anything in between
+	const unsigned char * format = nullptr;
+	uint32_t formatSize = 0;
+	const unsigned char * frames = nullptr;
+	size_t framesSize = 0;
+	for (size_t position = 12; position + 8 <= size;)
+	{
+		const unsigned char * chunk = data + position;
+		const size_t available = size - position - 8;
+		const size_t chunkSize = ReadU32(chunk + 4);
+		if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize <= available)
+		{
+			format = chunk + 8;
+			formatSize = (uint32_t)chunkSize;
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			// a file that was cut short still plays what it has
+			frames = chunk + 8;
+			framesSize = chunkSize < available ? chunkSize : available;
+			break;
+		}
+		// chunks are padded to an even length
+		position += 8 + chunkSize + (chunkSize & 1);
+	}
+
+	if (format == nullptr || formatSize < 16 || frames == nullptr)
+	{
+		return false;
+	}
+
+	const int channels = ReadU16(format + 2);
+	const int rate = (int)ReadU32(format + 4);
+	const int frameBytes = ReadU16(format + 12);
+	const int bits = ReadU16(format + 14);
+	uint16_t tag = ReadU16(format);
+	// WAVE_FORMAT_EXTENSIBLE keeps the actual format in the first two bytes of its sub format
+	if (tag == 0xFFFE && formatSize >= 26)
+	{
+		tag = ReadU16(format + 24);
+	}
+
+	WaveEncoding encoding = kWaveUnsupported;
+	if (tag == 1)
+	{
+		switch (bits)
+		{
+			case 8:  encoding = kWaveInt8;  break;
+			case 16: encoding = kWaveInt16; break;
+			case 24: encoding = kWaveInt24; break;
+			case 32: encoding = kWaveInt32; break;
+		}
+	}
+	else if (tag == 3)
+	{
+		switch (bits)
+		{
+			case 32: encoding = kWaveFloat32; break;
+			case 64: encoding = kWaveFloat64; break;
+		}
+	}
+
+	const int sampleBytes = bits / 8;
+	if (encoding == kWaveUnsupported || channels <= 0 || rate <= 0 || frameBytes != channels * sampleBytes)
+	{
+		return false;
+	}
+
+	const size_t fileFrames = framesSize / frameBytes;
+	const int totalFrames = fileFrames < (size_t)mMaxFrames ? (int)fileFrames : mMaxFrames;
+	outBuffer.setChannelCount(channels);
+	outBuffer.setBufferSize(totalFrames);
+	sampleRate = rate;
+
+	for (int offset = 0; offset < totalFrames; offset += kChunkFrames)
+	{
+		const int count = totalFrames - offset < kChunkFrames ? totalFrames - offset : kChunkFrames;
+		const unsigned char * chunk = frames + (size_t)offset * frameBytes;
+		switch (encoding)
+		{
+			case kWaveFloat32:
+				// already what we want, one channel needs nothing more than a copy
+				if (channels == 1)
+				{
+					memcpy(outBuffer.getChannel(0) + offset, chunk, count * sizeof(float));
+				}
+				else
+				{
+					DeinterleaveWave<DecodeFloat32>(chunk, frameBytes, sampleBytes, count, outBuffer, offset);
+				}
+				break;
+
+			case kWaveInt8:    DeinterleaveWave<DecodeInt8>(chunk, frameBytes, sampleBytes, count, outBuffer, offset);    break;
+			case kWaveInt16:   DeinterleaveWave<DecodeInt16>(chunk, frameBytes, sampleBytes, count, outBuffer, offset);   break;
+			case kWaveInt24:   DeinterleaveWave<DecodeInt24>(chunk, frameBytes, sampleBytes, count, outBuffer, offset);   break;
+			case kWaveInt32:   DeinterleaveWave<DecodeInt32>(chunk, frameBytes, sampleBytes, count, outBuffer, offset);   break;
+			case kWaveFloat64: DeinterleaveWave<DecodeFloat64>(chunk, frameBytes, sampleBytes, count, outBuffer, offset); break;
+			default: break;
+		}
+
+		if (progress && !progress((float)(offset + count) / totalFrames))
+		{
+			outBuffer.setBufferSize(0);
+			break;
+		}
+	}
+
+	return true;
+}
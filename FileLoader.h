@@ -3,18 +3,41 @@
 #include "MultiChannelBuffer.h"
 #include "sndfile.h"
 
-// helper class to load audio files from resources or from disk
+#include <functional>
+
+// helper class to load audio files from resources or from disk.
+// PCM and float WAV files are memory mapped and converted straight from the mapping into the channels,
+// everything else goes through libsndfile. either way files are decoded a chunk at a time, libsndfile
+// through a small scratch buffer that is reused from one load to the next, so loading a long file
+// takes no more memory than the channels it is decoded into.
 class FileLoader
 {
 public:
-	FileLoader();
-	void Load(int resourceID, const char * resourceName, Minim::MultiChannelBuffer& outBuffer);	
-	void Load(const char * fileName, Minim::MultiChannelBuffer& outBuffer);
+	// called after every chunk with how much of the file has been read, from 0 to 1.
+	// returning false stops the load, which leaves the buffer empty.
+	typedef std::function<bool(float)> Progress;
+
+	// files longer than maxFrames are cut off at that length
+	FileLoader(int maxFrames);
+	~FileLoader();
+
+	FileLoader(const FileLoader&) = delete;
+	FileLoader& operator=(const FileLoader&) = delete;
+
+	// resources are the audio files compiled into FileLoader.cpp, which are found by their ID and read in place.
+	// both return the sample rate of the file, or 0 if it could not be read
+	int Load(int resourceID, Minim::MultiChannelBuffer& outBuffer, const Progress& progress = Progress());
+	int Load(const char * fileName, Minim::MultiChannelBuffer& outBuffer, const Progress& progress = Progress());
 
 private:
 
-	void ReadFile(SF_INFO& info, SNDFILE* file, Minim::MultiChannelBuffer& outBuffer);
+	void ReadFile(SF_INFO& info, SNDFILE* file, Minim::MultiChannelBuffer& outBuffer, const Progress& progress);
+	// reads a whole WAV file held in memory. returns false, without touching outBuffer, if it isn't a WAV file
+	// or is in an encoding that needs libsndfile, otherwise sets sampleRate and returns true.
+	bool ReadWave(const unsigned char* data, size_t size, Minim::MultiChannelBuffer& outBuffer, const Progress& progress, int& sampleRate);
 
+	const int mMaxFrames;
+	// interleaved scratch for one chunk
 	float * mBuffer;
 	size_t  mBufferSize;
 };
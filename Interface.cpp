@@ -63,6 +63,11 @@ enum ELayout
   kLoadAudioControl_W = kControlPointSize,
   kLoadAudioControl_H = kPeaksControl_H,
 
+  kCancelLoadControl_X = kPeaksControl_X,
+  kCancelLoadControl_Y = kPeaksControl_Y,
+  kCancelLoadControl_W = kControlPointSize,
+  kCancelLoadControl_H = kPeaksControl_H,
+
   kVolumeControl_W = kLargeKnobSize,
   kVolumeControl_H = kLargeKnobSize,
   kVolumeControl_X = kLoadAudioControl_X + kLoadAudioControl_W + 25,
@@ -165,6 +170,8 @@ namespace Strings
 
   const char* LoadAudioLabel = ". . .";
   const char* AudioFileTypes = "wav au snd aif aiff flac ogg";
+  const char* CancelLoadLabel = "x";
+  const char* LoadFailed = "Could not load the file";
 
   const char* UpdateSnapshot = "+";
   const char* SnapshotSliderLabel = "";
@@ -174,6 +181,7 @@ Interface::Interface(PLUG_CLASS_NAME* inPlug)
 	: mPlug(inPlug)
 	, mPresetControl(nullptr)
 	, mPeaksControl(nullptr)
+	, mCancelLoadControl(nullptr)
 {
 	memset(mSnapshotControls, 0, sizeof(mSnapshotControls));
 }
@@ -181,8 +189,16 @@ Interface::Interface(PLUG_CLASS_NAME* inPlug)
 Interface::~Interface()
 {
 	mPlug = nullptr;
+	OnClose();
+}
+
+void Interface::OnClose()
+{
+	// the controls are freed along with the window, but the plug keeps calling in from OnIdle
 	mPresetControl = nullptr;
 	mPeaksControl = nullptr;
+	mCancelLoadControl = nullptr;
+	memset(mSnapshotControls, 0, sizeof(mSnapshotControls));
 }
 
 void Interface::CreateControls(IGraphics* pGraphics)
@@ -209,6 +225,7 @@ void Interface::CreateControls(IGraphics* pGraphics)
   {
     IRECT rect = MakeIRect(kPeaksControl).GetHPadded(-2 - kControlPointSize);
     mPeaksControl = new PeaksControl(rect, Color::PeaksBackground, Color::PeaksForeground);
+    mPeaksControl->SetText(TextStyles::Label);
     pGraphics->AttachControl(mPeaksControl);
     pGraphics->AttachControl(new ShaperVizControl(rect, Color::ShaperBracket, Color::ShaperLine));
   }
@@ -220,6 +237,11 @@ void Interface::CreateControls(IGraphics* pGraphics)
 
   pGraphics->AttachControl(new BangControl(MakeIRect(kLoadAudioControl), BangControl::ActionLoad, Color::BangOn, Color::BangOff, &TextStyles::Load, Strings::LoadAudioLabel, -1, Strings::AudioFileTypes));
 
+  // only shown while a file is loading, see SetLoadProgress
+  mCancelLoadControl = new BangControl(MakeIRect(kCancelLoadControl), BangControl::ActionCancelLoad, Color::BangOn, Color::BangOff, &TextStyles::Load, Strings::CancelLoadLabel);
+  pGraphics->AttachControl(mCancelLoadControl);
+  mCancelLoadControl->Hide(true);
+
   for (int i = 0; i < kNoiseSnapshotCount; ++i)
   {
     int voff = (kControlSnapshot_H + kControlSnapshot_S) * i;
@@ -320,7 +342,7 @@ void Interface::OnPresetChanged()
 
 void Interface::UpdateSnapshot(const int idx)
 {
-	if (mSnapshotControls != nullptr)
+	if (mSnapshotControls[idx] != nullptr)
 	{
 		mSnapshotControls[idx]->Update();
 	}
@@ -334,6 +356,41 @@ void Interface::RebuildPeaks(const Minim::MultiChannelBuffer& forSamples)
 	}
 }
 
+void Interface::SetPeaks(const std::vector<float>& peaks)
+{
+	if (mPeaksControl != nullptr)
+	{
+		mPeaksControl->SetPeaks(peaks.data(), (int)peaks.size());
+	}
+}
+
+int Interface::GetPeaksSize() const
+{
+	return mPeaksControl != nullptr ? mPeaksControl->GetPeaksSize() : 0;
+}
+
+void Interface::SetLoadProgress(float progress)
+{
+	if (mPeaksControl != nullptr)
+	{
+		mPeaksControl->SetProgress(progress);
+	}
+
+	// Hide redraws the control, so it is only called when it changes
+	if (mCancelLoadControl != nullptr && mCancelLoadControl->IsHidden() != (progress < 0))
+	{
+		mCancelLoadControl->Hide(progress < 0);
+	}
+}
+
+void Interface::ShowLoadFailed()
+{
+	if (mPeaksControl != nullptr)
+	{
+		mPeaksControl->SetMessage(Strings::LoadFailed);
+	}
+}
+
 void Interface::BeginMIDILearn(IEditorDelegate* plug, const int paramIdx1, const int paramIdx2, const int x, const int y)
 {
 	PLUG_CLASS_NAME *quartzPlug = dynamic_cast<PLUG_CLASS_NAME *>(plug);
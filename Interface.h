@@ -4,6 +4,8 @@
 #include "IGraphicsStructs.h"
 #include "Params.h"
 
+#include <vector>
+
 class PLUG_CLASS_NAME;
 class KnobLineCoronaControl;
 class PeaksControl;
@@ -29,6 +31,9 @@ public:
 	~Interface();
 
 	void CreateControls(IGraphics* pGraphics);
+	// called by the plug when the editor closes, after which everything below does nothing until
+	// CreateControls is called again
+	void OnClose();
 
 	// called by the plug when a preset is loaded or saved
 	void OnPresetChanged();
@@ -38,6 +43,15 @@ public:
 
 	// called when the plug loads a new audio file
 	void RebuildPeaks(const Minim::MultiChannelBuffer& forSamples);
+	// called when the plug has finished loading a file in the background, with peaks already measured
+	void SetPeaks(const std::vector<float>& peaks);
+	// how many peaks the waveform view draws, or 0 when the editor is closed
+	int GetPeaksSize() const;
+	// called by the plug while a file loads in the background, progress is -1 when nothing is loading.
+	// the button that cancels the load is only shown while there is one.
+	void SetLoadProgress(float progress);
+	// called by the plug when a file it was loading could not be decoded
+	void ShowLoadFailed();
 
 	// used by Controls to initiate MIDILearn functionality in the Standalone
 	static void BeginMIDILearn(IEditorDelegate* plug, const int paramIdx1, const int paramIdx2, const int x, const int y);
@@ -51,6 +65,7 @@ private:
 
 	IControl* mPresetControl;
 	PeaksControl* mPeaksControl;
+	IControl* mCancelLoadControl;
 	SnapshotControl* mSnapshotControls[kNoiseSnapshotCount];
 };
 
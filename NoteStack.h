@@ -0,0 +1,124 @@
+#pragma once
+
+#include "IPlugStructs.h"
+
+using namespace iplug;
+
+// Fixed capacity stack of held MIDI notes used on the audio thread.
+// Every note on every channel has its own preallocated slot and the held notes are linked
+// together in the order they were pressed, so pushing, looking up the most recent note and
+// removing any note are all constant time and nothing is ever allocated.
+class NoteStack
+{
+public:
+  enum
+  {
+    kNotesPerChannel = 128,
+    kChannels = 16,
+    kSlots = kNotesPerChannel * kChannels,
+  };
+
+  NoteStack()
+  {
+    Clear();
+  }
+
+  void Clear()
+  {
+    for (int i = 0; i < kSlots; ++i)
+    {
+      mSlots[i].prev = mSlots[i].next = kNone;
+      mSlots[i].velocity = 0;
+      mSlots[i].count = 0;
+    }
+    mTop = kNone;
+  }
+
+  bool Empty() const { return mTop == kNone; }
+
+  // a note pressed again while it is still held moves to the top of the stack,
+  // and needs to be released as many times as it was pressed before it is removed.
+  void Push(const IMidiMsg& msg)
+  {
+    const int idx = Index(msg);
+    Slot& slot = mSlots[idx];
+    if (slot.count > 0)
+    {
+      Unlink(idx);
+    }
+
+    if (slot.count < 255)
+    {
+      ++slot.count;
+    }
+    slot.velocity = (unsigned char)msg.Velocity();
+    slot.prev = mTop;
+    slot.next = kNone;
+    if (mTop != kNone)
+    {
+      mSlots[mTop].next = (short)idx;
+    }
+    mTop = (short)idx;
+  }
+
+  // returns true if the note was held
+  bool Remove(const IMidiMsg& msg)
+  {
+    const int idx = Index(msg);
+    Slot& slot = mSlots[idx];
+    if (slot.count == 0)
+    {
+      return false;
+    }
+
+    if (--slot.count == 0)
+    {
+      Unlink(idx);
+    }
+    return true;
+  }
+
+  bool IsHeld(const IMidiMsg& msg) const { return mSlots[Index(msg)].count > 0; }
+
+  // the most recently pressed note that is still held, only valid when not Empty
+  int TopNoteNumber() const { return mTop % kNotesPerChannel; }
+  int TopChannel() const { return mTop / kNotesPerChannel; }
+  int TopVelocity() const { return mSlots[mTop].velocity; }
+
+private:
+  enum { kNone = -1 };
+
+  struct Slot
+  {
+    // neighbours in press order, prev being the note pressed before this one
+    short prev, next;
+    unsigned char velocity;
+    unsigned char count;
+  };
+
+  static int Index(const IMidiMsg& msg)
+  {
+    return msg.Channel() * kNotesPerChannel + (msg.NoteNumber() & (kNotesPerChannel - 1));
+  }
+
+  void Unlink(const int idx)
+  {
+    Slot& slot = mSlots[idx];
+    if (slot.prev != kNone)
+    {
+      mSlots[slot.prev].next = slot.next;
+    }
+    if (slot.next != kNone)
+    {
+      mSlots[slot.next].prev = slot.prev;
+    }
+    else
+    {
+      mTop = slot.prev;
+    }
+    slot.prev = slot.next = kNone;
+  }
+
+  Slot mSlots[kSlots];
+  short mTop;
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+// Polyphase half-band filters used to run the waveshaper at a multiple of the host rate.
+// Every other tap of a half-band filter is zero apart from the center one, so each 2x stage
+// splits into a branch that is only a delay and a short symmetric branch, and only the
+// samples that are actually kept are ever computed. Up to three stages are cascaded for 8x,
+// with the later stages, which only have to reject what is far above the host's Nyquist,
+// using shorter filters than the first.
+
+#include <cmath>
+
+namespace block
+{
+  // the K taps on one side of the center of a half-band lowpass with 4K-1 taps that are
+  // an odd distance from the center, nearest first. the center tap is always 0.5.
+  // windowed sinc with a Blackman window, normalized for unity gain at DC.
+  template<typename T, int K>
+  const T* halfbandCoefficients()
+  {
+    struct table
+    {
+      table()
+      {
+        const double pi = 3.141592653589793;
+        double sum = 0;
+        for (int j = 0; j < K; ++j)
+        {
+          const int k = 2 * j + 1;
+          const double window = 0.42 + 0.5*std::cos(pi * k / (2 * K)) + 0.08*std::cos(2 * pi * k / (2 * K));
+          c[j] = std::sin(pi * k / 2) / (pi * k) * window;
+          sum += c[j];
+        }
+        // the center tap plus both sides should add up to 1
+        for (int j = 0; j < K; ++j)
+        {
+          c[j] *= 0.25 / sum;
+        }
+      }
+
+      T c[K];
+    };
+
+    static const table coefficients;
+    return coefficients.c;
+  }
+
+  // doubles the rate of a signal, delaying it by 2K-1 samples at the new rate
+  template<typename T, int K>
+  class halfbandUp
+  {
+  public:
+    halfbandUp() : mCoefficients(halfbandCoefficients<T, K>()) { reset(); }
+
+    void reset()
+    {
+      for (T& x : mHistory) x = 0;
+      mWrite = 0;
+    }
+
+    // writes 2 * nFrames samples to out
+    void render(T* out, const T* in, const int nFrames)
+    {
+      for (int s = 0; s < nFrames; ++s)
+      {
+        // the history is stored twice so that the last kHistory inputs are always contiguous, oldest first
+        mHistory[mWrite] = mHistory[mWrite + kHistory] = in[s];
+        const T* x = mHistory + mWrite + 1;
+        mWrite = mWrite + 1 == kHistory ? 0 : mWrite + 1;
+
+        T sum = 0;
+        for (int j = 0; j < K; ++j)
+        {
+          sum += mCoefficients[j] * (x[K + j] + x[K - 1 - j]);
+        }
+        // the inserted zeros halve the level, which the filter makes up for
+        out[s * 2] = sum * 2;
+        out[s * 2 + 1] = x[K];
+      }
+    }
+
+  private:
+    enum { kHistory = 2 * K };
+
+    const T* mCoefficients;
+    T mHistory[kHistory * 2];
+    int mWrite;
+  };
+
+  // halves the rate of a signal, delaying it by 2K-1 samples at the old rate
+  template<typename T, int K>
+  class halfbandDown
+  {
+  public:
+    halfbandDown() : mCoefficients(halfbandCoefficients<T, K>()) { reset(); }
+
+    void reset()
+    {
+      for (T& x : mEven) x = 0;
+      for (T& x : mOdd) x = 0;
+      mWrite = 0;
+      mOddWrite = 0;
+    }
+
+    // reads 2 * nFrames samples from in
+    void render(T* out, const T* in, const int nFrames)
+    {
+      for (int s = 0; s < nFrames; ++s)
+      {
+        mEven[mWrite] = mEven[mWrite + kHistory] = in[s * 2];
+        const T* x = mEven + mWrite + 1;
+        mWrite = mWrite + 1 == kHistory ? 0 : mWrite + 1;
+
+        T sum = 0;
+        for (int j = 0; j < K; ++j)
+        {
+          sum += mCoefficients[j] * (x[K + j] + x[K - 1 - j]);
+        }
+
+        // the odd samples only pass through the center tap, so they just need delaying
+        out[s] = sum + mOdd[mOddWrite] * (T)0.5;
+        mOdd[mOddWrite] = in[s * 2 + 1];
+        mOddWrite = mOddWrite + 1 == K ? 0 : mOddWrite + 1;
+      }
+    }
+
+  private:
+    enum { kHistory = 2 * K };
+
+    const T* mCoefficients;
+    T mEven[kHistory * 2];
+    T mOdd[K];
+    int mWrite;
+    int mOddWrite;
+  };
+
+  // how many frames at the original rate oversampling by factor delays a signal
+  // that is converted up and back down again. the filters are symmetric, so this is exact.
+  inline double oversamplingLatency(const int factor)
+  {
+    // each stage delays by 2K-1 samples on the way up and again on the way down, at twice the rate it started from
+    const double stage1 = (2 * 8 - 1) * 2 / 2.0;
+    const double stage2 = (2 * 4 - 1) * 2 / 4.0;
+    const double stage3 = (2 * 4 - 1) * 2 / 8.0;
+    switch (factor)
+    {
+      case 2: return stage1;
+      case 4: return stage1 + stage2;
+      case 8: return stage1 + stage2 + stage3;
+      default: return 0;
+    }
+  }
+
+  // raises the rate of a signal by a factor of 1, 2, 4 or 8
+  template<typename T>
+  class upsampler
+  {
+  public:
+    upsampler() : mFactor(1) {}
+
+    // clears the filters when the factor changes
+    void setFactor(const int factor)
+    {
+      mFactor = factor;
+      reset();
+    }
+
+    void reset()
+    {
+      mStage1.reset();
+      mStage2.reset();
+      mStage3.reset();
+    }
+
+    int getFactor() const { return mFactor; }
+
+    // writes nFrames * factor samples to out. scratch needs room for as many.
+    void render(T* out, const T* in, const int nFrames, T* scratch)
+    {
+      switch (mFactor)
+      {
+        case 2:
+          mStage1.render(out, in, nFrames);
+          break;
+
+        case 4:
+          mStage1.render(scratch, in, nFrames);
+          mStage2.render(out, scratch, nFrames * 2);
+          break;
+
+        case 8:
+          mStage1.render(out, in, nFrames);
+          mStage2.render(scratch, out, nFrames * 2);
+          mStage3.render(out, scratch, nFrames * 4);
+          break;
+
+        default:
+          for (int s = 0; s < nFrames; ++s)
+          {
+            out[s] = in[s];
+          }
+          break;
+      }
+    }
+
+  private:
+    int mFactor;
+    halfbandUp<T, 8> mStage1;
+    halfbandUp<T, 4> mStage2;
+    halfbandUp<T, 4> mStage3;
+  };
+
+  // lowers the rate of a signal raised by an upsampler with the same factor back to where it was
+  template<typename T>
+  class downsampler
+  {
+  public:
+    downsampler() : mFactor(1) {}
+
+    void setFactor(const int factor)
+    {
+      mFactor = factor;
+      mStage1.reset();
+      mStage2.reset();
+      mStage3.reset();
+    }
+
+    int getFactor() const { return mFactor; }
+
+    // reads nFrames * factor samples from in and writes nFrames samples to out.
+    // scratch needs room for half as many samples as in.
+    void render(T* out, const T* in, const int nFrames, T* scratch)
+    {
+      switch (mFactor)
+      {
+        case 2:
+          mStage1.render(out, in, nFrames);
+          break;
+
+        case 4:
+          mStage2.render(scratch, in, nFrames * 2);
+          mStage1.render(out, scratch, nFrames);
+          break;
+
+        case 8:
+          mStage3.render(scratch, in, nFrames * 4);
+          mStage2.render(scratch, scratch, nFrames * 2);
+          mStage1.render(out, scratch, nFrames);
+          break;
+
+        default:
+          for (int s = 0; s < nFrames; ++s)
+          {
+            out[s] = in[s];
+          }
+          break;
+      }
+    }
+
+  private:
+    int mFactor;
+    halfbandDown<T, 8> mStage1;
+    halfbandDown<T, 4> mStage2;
+    halfbandDown<T, 4> mStage3;
+  };
+}
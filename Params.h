@@ -18,6 +18,15 @@ enum EParams
 	kEnvSustain,
 	kEnvRelease,
 
+	// how many times the host rate the waveshaper runs at, to keep fast scrubbing from aliasing
+	kOversampling,
+
+	// how the waveshaper interpolates between frames of the wavetable
+	kInterpolation,
+
+	// whether the envelope segments are straight lines or exponential curves
+	kEnvCurve,
+
 	kNumParams,
 };
 
@@ -43,6 +52,33 @@ enum ENoiseType
 	NT_Count,
 };
 
+enum EOversampling
+{
+	OS_1x,
+	OS_2x,
+	OS_4x,
+	OS_8x,
+
+	OS_Count,
+};
+
+enum EInterpolation
+{
+	IM_Linear,
+	IM_Hermite,
+	IM_Optimal,
+
+	IM_Count,
+};
+
+enum EEnvelopeCurve
+{
+	EC_Linear,
+	EC_Exponential,
+
+	EC_Count,
+};
+
 enum ECtrlTags
 {
   kCtrlTagMeter = 0,
@@ -0,0 +1,111 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  const int kZeroCrossings = 32;
+  const int kPhases = 256;
+  // how much of the lower Nyquist frequency is passed, leaving room for the filter to roll off
+  const double kCutoff = 0.9;
+  // about 80dB of stop band attenuation
+  const double kKaiserBeta = 8;
+
+  // the modified Bessel function of the first kind, order 0, the Kaiser window is built from
+  double BesselI0(const double x)
+  {
+    double sum = 1;
+    double term = 1;
+    for (int k = 1; k < 64 && term > sum * 1e-12; ++k)
+    {
+      const double half = x / (2 * k);
+      term *= half * half;
+      sum += term;
+    }
+    return sum;
+  }
+}
+
+Resampler::Resampler(double fromRate, double toRate)
+  : mStep(fromRate / toRate)
+{
+  const double pi = 3.141592653589793;
+
+  // when going down in rate the sinc is stretched to cut off below the new Nyquist, so it needs more taps
+  const double cutoff = kCutoff * std::min(1.0, toRate / fromRate);
+  const int half = (int)std::ceil(kZeroCrossings / cutoff);
+  mLead = half - 1;
+  mTaps = (2 * half + 3) / 4 * 4;
+  mFilter.assign((kPhases + 1) * mTaps, 0.f);
+
+  const double windowScale = 1 / BesselI0(kKaiserBeta);
+  for (int p = 0; p <= kPhases; ++p)
+  {
+    float* phase = &mFilter[p * mTaps];
+    double sum = 0;
+    for (int k = 0; k < 2 * half; ++k)
+    {
+      // how far the tap's input frame is from the output frame, in input frames
+      const double t = k - mLead - (double)p / kPhases;
+      const double x = t / half;
+      if (std::abs(x) >= 1)
+      {
+        continue;
+      }
+
+      const double arg = pi * cutoff * t;
+      const double sinc = arg == 0 ? 1 : std::sin(arg) / arg;
+      const double window = BesselI0(kKaiserBeta * std::sqrt(1 - x * x)) * windowScale;
+      phase[k] = (float)(sinc * window);
+      sum += sinc * window;
+    }
+
+    // every phase passes DC at exactly unity gain
+    for (int k = 0; k < mTaps; ++k)
+    {
+      phase[k] = (float)(phase[k] / sum);
+    }
+  }
+}
+
+int Resampler::GetOutputFrames(int inputFrames) const
+{
+  return (int)std::floor(inputFrames / mStep + 0.5);
+}
+
+void Resampler::Process(const float* in, int inputFrames, float* out, int outputFrames) const
+{
+  // padded with silence on both sides, so the taps near the ends never have to be checked
+  std::vector<float> padded(inputFrames + 2 * mTaps, 0.f);
+  std::copy(in, in + inputFrames, padded.begin() + mTaps);
+
+  for (int i = 0; i < outputFrames; ++i)
+  {
+    const double position = i * mStep;
+    const int frame = (int)position;
+    const double phase = (position - frame) * kPhases;
+    const int p = std::min((int)phase, kPhases - 1);
+    const float blend = (float)(phase - p);
+
+    const float* x = padded.data() + mTaps + frame - mLead;
+    const float* a = &mFilter[p * mTaps];
+    const float* b = a + mTaps;
+
+    // four independent sums, so the dot products run across the lanes of a vector register
+    float sumA[4] = { 0, 0, 0, 0 };
+    float sumB[4] = { 0, 0, 0, 0 };
+    for (int k = 0; k < mTaps; k += 4)
+    {
+      for (int lane = 0; lane < 4; ++lane)
+      {
+        sumA[lane] += a[k + lane] * x[k + lane];
+        sumB[lane] += b[k + lane] * x[k + lane];
+      }
+    }
+
+    const float first = (sumA[0] + sumA[1]) + (sumA[2] + sumA[3]);
+    const float second = (sumB[0] + sumB[1]) + (sumB[2] + sumB[3]);
+    out[i] = first + (second - first) * blend;
+  }
+}
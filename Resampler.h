@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+// Converts whole signals from one sample rate to another, for samples recorded at a different
+// rate than the host is running at.
+//
+// Each output frame is a windowed sinc interpolation of the input around it. The sinc is cut off
+// a little below the lower of the two Nyquist frequencies, so nothing is left above the host's to
+// alias, and is shaped by a Kaiser window 32 zero crossings wide. The filter is sampled at a fixed
+// number of phases between two input frames, and the two phases either side of each output frame
+// are blended, so any ratio between the rates can be converted without ever evaluating the
+// sinc while processing.
+//
+// Process only reads the filter, so the channels of a sample can be converted on separate threads
+// with one Resampler.
+class Resampler
+{
+public:
+  Resampler(double fromRate, double toRate);
+
+  // how many frames inputFrames frames come to at the new rate
+  int GetOutputFrames(int inputFrames) const;
+
+  // converts in, which holds inputFrames frames, filling out with outputFrames frames
+  void Process(const float* in, int inputFrames, float* out, int outputFrames) const;
+
+private:
+  // input frames between output frames
+  double mStep;
+  // taps in each phase of the filter, a multiple of 4 so the dot products can be split across lanes
+  int mTaps;
+  // the first tap of each phase sits this many frames before the frame at or before the output frame
+  int mLead;
+  // kPhases + 1 phases of mTaps taps each, the last one being the first one shifted by a whole frame
+  std::vector<float> mFilter;
+};
@@ -0,0 +1,248 @@
+#include "SampleCache.h"
+#include "Resampler.h"
+
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+SampleCache& SampleCache::Instance()
+{
+  static SampleCache cache;
+  return cache;
+}
+
+SampleCache::Handle SampleCache::LoadFile(const char* fileName, FileLoader& loader, const FileLoader::Progress& progress)
+{
+  // a file that has been written to since it was cached is loaded again
+  std::string key = std::string("file:") + fileName;
+  struct stat info;
+  if (stat(fileName, &info) == 0)
+  {
+    key += "@" + std::to_string((long long)info.st_mtime);
+  }
+
+  return Acquire(key, [fileName, &loader, &progress]
+  {
+    std::shared_ptr<Sample> sample = std::make_shared<Sample>();
+    sample->sampleRate = loader.Load(fileName, sample->buffer, progress);
+    return sample;
+  });
+}
+
+SampleCache::Handle SampleCache::LoadResource(int resourceID, const char* resourceName, FileLoader& loader)
+{
+  const std::string key = "resource:" + std::to_string(resourceID) + ":" + resourceName;
+
+  return Acquire(key, [resourceID, &loader]
+  {
+    std::shared_ptr<Sample> sample = std::make_shared<Sample>();
+    sample->sampleRate = loader.Load(resourceID, sample->buffer);
+    return sample;
+  });
+}
+
+SampleCache::Handle SampleCache::Convert(const Handle& sample, double sampleRate)
+{
+  // always converted from the frames as they were decoded
+  const Handle source = sample->original != nullptr ? sample->original : sample;
+  if (source->sampleRate == sampleRate || source->sampleRate <= 0 || sampleRate <= 0)
+  {
+    return source;
+  }
+
+  const std::string key = "rate:" + std::to_string(source->hash) + ":" + std::to_string(source->buffer.getBufferSize())
+                        + "@" + std::to_string(sampleRate);
+
+  return Acquire(key, [&source, sampleRate]
+  {
+    const Resampler resampler(source->sampleRate, sampleRate);
+    const Minim::MultiChannelBuffer& from = source->buffer;
+    const int channels = from.getChannelCount();
+    const int frames = resampler.GetOutputFrames(from.getBufferSize());
+
+    std::shared_ptr<Sample> converted = std::make_shared<Sample>();
+    converted->sampleRate = sampleRate;
+    converted->original = source;
+    Minim::MultiChannelBuffer& to = converted->buffer;
+    to.setChannelCount(channels);
+    to.setBufferSize(frames);
+
+    // each channel is converted on a thread of its own, the first one on this thread
+    std::vector<std::thread> workers;
+    for (int c = 1; c < channels; ++c)
+    {
+      workers.emplace_back([&resampler, &from, &to, frames, c]
+      {
+        resampler.Process(from.getChannel(c), from.getBufferSize(), to.getChannel(c), frames);
+      });
+    }
+    if (channels > 0)
+    {
+      resampler.Process(from.getChannel(0), from.getBufferSize(), to.getChannel(0), frames);
+    }
+    for (std::thread& worker : workers)
+    {
+      worker.join();
+    }
+
+    return converted;
+  });
+}
+
+SampleCache::Handle SampleCache::Acquire(const std::string& key, const std::function<std::shared_ptr<Sample>()>& make)
+{
+  for (;;)
+  {
+    std::promise<Handle> made;
+    std::shared_future<Handle> pending;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (Handle cached = Find(key))
+      {
+        return cached;
+      }
+
+      auto inFlight = mInFlight.find(key);
+      if (inFlight == mInFlight.end())
+      {
+        mInFlight.emplace(key, made.get_future().share());
+      }
+      else
+      {
+        pending = inFlight->second;
+      }
+    }
+
+    if (pending.valid())
+    {
+      // somebody else is already making it. if they fail, or give up part way, try again ourselves.
+      if (Handle shared = pending.get())
+      {
+        return shared;
+      }
+      continue;
+    }
+
+    std::shared_ptr<Sample> sample;
+    try
+    {
+      sample = make();
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mInFlight.erase(key);
+      made.set_value(nullptr);
+      throw;
+    }
+
+    // hashed before taking the lock, it reads every frame
+    const bool empty = sample == nullptr || sample->buffer.getBufferSize() == 0 || sample->buffer.getChannelCount() == 0;
+    if (!empty)
+    {
+      sample->hash = Hash(sample->buffer);
+    }
+
+    Handle added;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (!empty)
+      {
+        added = Insert(key, std::move(sample));
+      }
+      mInFlight.erase(key);
+    }
+    made.set_value(added);
+    return added;
+  }
+}
+
+SampleCache::Handle SampleCache::Find(const std::string& key)
+{
+  auto found = mByKey.find(key);
+  if (found == mByKey.end())
+  {
+    return nullptr;
+  }
+
+  Handle sample = found->second.lock();
+  if (sample == nullptr)
+  {
+    mByKey.erase(found);
+  }
+  return sample;
+}
+
+SampleCache::Handle SampleCache::Insert(const std::string& key, std::shared_ptr<Sample> sample)
+{
+  const Minim::MultiChannelBuffer& buffer = sample->buffer;
+
+  // forget everything that has been freed since the last time around
+  for (auto it = mByKey.begin(); it != mByKey.end();)
+  {
+    it = it->second.expired() ? mByKey.erase(it) : std::next(it);
+  }
+  for (auto it = mByHash.begin(); it != mByHash.end();)
+  {
+    it = it->second.expired() ? mByHash.erase(it) : std::next(it);
+  }
+
+  auto range = mByHash.equal_range(sample->hash);
+  for (auto it = range.first; it != range.second; ++it)
+  {
+    Handle existing = it->second.lock();
+    if (existing != nullptr && existing->sampleRate == sample->sampleRate && Equal(existing->buffer, buffer))
+    {
+      mByKey[key] = existing;
+      return existing;
+    }
+  }
+
+  Handle added = std::move(sample);
+  mByKey[key] = added;
+  mByHash.emplace(added->hash, added);
+  return added;
+}
+
+uint64_t SampleCache::Hash(const Minim::MultiChannelBuffer& buffer)
+{
+  // 64-bit FNV-1a over the shape of the buffer and then the bits of every frame
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](const void* data, size_t bytes)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < bytes; ++i)
+    {
+      hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+  };
+
+  const int channels = buffer.getChannelCount();
+  const int frames = buffer.getBufferSize();
+  mix(&channels, sizeof(channels));
+  mix(&frames, sizeof(frames));
+  for (int c = 0; c < channels; ++c)
+  {
+    mix(buffer.getChannel(c), frames * sizeof(float));
+  }
+  return hash;
+}
+
+bool SampleCache::Equal(const Minim::MultiChannelBuffer& a, const Minim::MultiChannelBuffer& b)
+{
+  if (a.getChannelCount() != b.getChannelCount() || a.getBufferSize() != b.getBufferSize())
+  {
+    return false;
+  }
+
+  for (int c = 0; c < a.getChannelCount(); ++c)
+  {
+    if (memcmp(a.getChannel(c), b.getChannel(c), a.getBufferSize() * sizeof(float)) != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "FileLoader.h"
+#include "MultiChannelBuffer.h"
+#include "WavetableStore.h"
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Decoded samples shared by every plugin instance in the process.
+//
+// A sample is decoded and has its wavetable built once and is then never changed, so instances that
+// load the same file, or the same embedded resource, all hold a reference to one copy of it. Samples
+// are looked up by where they came from, which for files includes when they were last modified, and
+// then by a hash of the decoded frames, so a file that has been copied or renamed is still only kept
+// once. A sample is freed as soon as the last instance lets go of it, the cache only remembers it
+// for as long as somebody is using it.
+//
+// Samples are played at the host's rate, so one decoded at any other rate is converted to it, see
+// Convert. The converted sample is cached like any other and keeps the one it was converted from alive,
+// so that a later change of host rate converts from the frames as they were decoded rather than
+// from a copy that has already been filtered once.
+class SampleCache
+{
+public:
+  struct Sample
+  {
+    // the frames as they were decoded, or converted, for drawing and for the Minim engine
+    Minim::MultiChannelBuffer buffer;
+    uint64_t hash;
+    // the rate of the frames in buffer
+    double sampleRate;
+    // the sample as it was decoded, when this one was converted from it to a different rate
+    std::shared_ptr<const Sample> original;
+
+    // the same frames ready to be played by a block engine rendering at precision T.
+    // built the first time it is asked for, so only the precisions actually in use take up memory.
+    template<typename T>
+    const typename WavetableStore<T>::Table& GetTable() const
+    {
+      Lazy<T>& lazy = Select((T*)nullptr);
+      std::call_once(lazy.built, [this, &lazy] { Build<T>(lazy.table); });
+      return lazy.table;
+    }
+
+  private:
+    template<typename T>
+    struct Lazy
+    {
+      std::once_flag built;
+      typename WavetableStore<T>::Table table;
+    };
+
+    Lazy<float>& Select(float*) const { return mFloatTable; }
+    Lazy<double>& Select(double*) const { return mDoubleTable; }
+
+    template<typename T>
+    void Build(typename WavetableStore<T>::Table& table) const
+    {
+      const float* left = buffer.getChannel(0);
+      const float* right = buffer.getChannelCount() > 1 ? buffer.getChannel(1) : left;
+      table.Build(left, right, buffer.getBufferSize());
+    }
+
+    mutable Lazy<float> mFloatTable;
+    mutable Lazy<double> mDoubleTable;
+  };
+
+  typedef std::shared_ptr<const Sample> Handle;
+
+  static SampleCache& Instance();
+
+  // returns the cached sample for the file, decoding it with loader when it isn't cached.
+  // returns null if the file could not be read or progress stopped the decode.
+  Handle LoadFile(const char* fileName, FileLoader& loader, const FileLoader::Progress& progress = FileLoader::Progress());
+  // the same for a sample embedded in the plugin
+  Handle LoadResource(int resourceID, const char* resourceName, FileLoader& loader);
+
+  // returns the cached copy of sample at sampleRate, converting it when it isn't cached.
+  // returns the original sample when that is already at sampleRate.
+  Handle Convert(const Handle& sample, double sampleRate);
+
+  // UI thread: the table of sample in a form that can be handed to a WavetableStore, keeping the whole sample alive
+  template<typename T>
+  static std::shared_ptr<const typename WavetableStore<T>::Table> GetTable(const Handle& sample)
+  {
+    return std::shared_ptr<const typename WavetableStore<T>::Table>(sample, &sample->GetTable<T>());
+  }
+
+private:
+  SampleCache() {}
+
+  // returns the sample cached under key, or calls make to create it without holding mMutex. callers asking for
+  // a key that is already being made wait for that one instead of making it again. returns null if make fails.
+  Handle Acquire(const std::string& key, const std::function<std::shared_ptr<Sample>()>& make);
+  // adds a newly decoded sample, which has already been hashed, under key, or returns an identical one that
+  // is already cached instead. must be called with mMutex held.
+  Handle Insert(const std::string& key, std::shared_ptr<Sample> sample);
+  // looks up key, forgetting it if its sample has since been freed. must be called with mMutex held.
+  Handle Find(const std::string& key);
+
+  static uint64_t Hash(const Minim::MultiChannelBuffer& buffer);
+  static bool Equal(const Minim::MultiChannelBuffer& a, const Minim::MultiChannelBuffer& b);
+
+  // only held to look samples up and add them, never while one is decoded or converted
+  std::mutex mMutex;
+  std::unordered_map<std::string, std::weak_ptr<const Sample>> mByKey;
+  std::unordered_multimap<uint64_t, std::weak_ptr<const Sample>> mByHash;
+  // the samples being made right now, so that instances asking for the same one at once make it only once
+  std::unordered_map<std::string, std::shared_future<Handle>> mInFlight;
+};
@@ -0,0 +1,232 @@
+#include "SampleLoader.h"
+
+#include <cmath>
+
+namespace
+{
+  // rough share of a load each step takes, for the progress reported while it runs
+  const float kDecodedProgress = 0.5f;
+  const float kConvertedProgress = 0.7f;
+  const float kPreparedProgress = 0.9f;
+}
+
+SampleLoader::SampleLoader(int maxFrames, Prepare prepare)
+  : mFileLoader(maxFrames)
+  , mPrepare(prepare)
+  , mRequested(false)
+  , mRequestedPeakCount(0)
+  , mRequestedRate(0)
+  , mHasResult(false)
+  , mQuit(false)
+  , mGeneration(0)
+  , mProgress(-1)
+{
+}
+
+SampleLoader::~SampleLoader()
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQuit = true;
+    ++mGeneration;
+  }
+  mWake.notify_one();
+
+  // a decode in flight stops at the end of its current chunk
+  if (mThread.joinable())
+  {
+    mThread.join();
+  }
+}
+
+SampleCache::Handle SampleLoader::LoadResource(int resourceID, const char* resourceName)
+{
+  return SampleCache::Instance().LoadResource(resourceID, resourceName, mFileLoader);
+}
+
+void SampleLoader::Request(const char* fileName, int peakCount, double sampleRate)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequestedFile = fileName;
+    mRequestedSample = nullptr;
+    mRequestedPeakCount = peakCount;
+    mRequestedRate = sampleRate;
+    Queue();
+  }
+  mWake.notify_one();
+}
+
+void SampleLoader::Request(const SampleCache::Handle& sample, int peakCount, double sampleRate)
+{
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRequestedFile.clear();
+    mRequestedSample = sample;
+    mRequestedPeakCount = peakCount;
+    mRequestedRate = sampleRate;
+    Queue();
+  }
+  mWake.notify_one();
+}
+
+void SampleLoader::Queue()
+{
+  mRequested = true;
+  // a finished load that hasn't been collected yet has been superseded as well
+  mHasResult = false;
+  mResult = Result();
+  ++mGeneration;
+  mProgress = 0;
+
+  if (!mThread.joinable())
+  {
+    mThread = std::thread(&SampleLoader::Run, this);
+  }
+}
+
+void SampleLoader::Cancel()
+{
+  std::lock_guard<std::mutex> lock(mMutex);
+  mRequested = false;
+  mRequestedSample = nullptr;
+  mHasResult = false;
+  mResult = Result();
+  ++mGeneration;
+  mProgress = -1;
+}
+
+bool SampleLoader::Poll(Result& result)
+{
+  // the worker only holds the lock long enough to pick up a request or leave a result
+  std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+  if (!lock.owns_lock() || !mHasResult)
+  {
+    return false;
+  }
+
+  result = std::move(mResult);
+  mResult = Result();
+  mHasResult = false;
+  mProgress = -1;
+  return true;
+}
+
+void SampleLoader::Run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  for (;;)
+  {
+    mWake.wait(lock, [this] { return mQuit || mRequested; });
+    if (mQuit)
+    {
+      return;
+    }
+
+    mRequested = false;
+    const std::string fileName = std::move(mRequestedFile);
+    mRequestedFile.clear();
+    SampleCache::Handle sample = std::move(mRequestedSample);
+    mRequestedSample = nullptr;
+    const int peakCount = mRequestedPeakCount;
+    const double sampleRate = mRequestedRate;
+    const unsigned generation = mGeneration;
+
+    lock.unlock();
+    Result result = Load(fileName, std::move(sample), peakCount, sampleRate, generation);
+    lock.lock();
+
+    // nothing newer can have been asked for while the lock is held, so this is still the load the UI wants,
+    // and an empty result means it failed. either way the progress stays where it is until the result is
+    // collected, so the UI can tell one is waiting.
+    if (IsCurrent(generation))
+    {
+      mHasResult = true;
+      mResult = std::move(result);
+      mProgress = 1;
+    }
+  }
+}
+
+SampleLoader::Result SampleLoader::Load(const std::string& fileName, SampleCache::Handle sample, int peakCount, double sampleRate, unsigned generation)
+{
+  Result result;
+
+  if (!fileName.empty())
+  {
+    // the decode reports back after every chunk, and stops as soon as the load is superseded
+    auto decoding = [this, generation](float read)
+    {
+      Report(generation, read * kDecodedProgress);
+      return IsCurrent(generation);
+    };
+    sample = SampleCache::Instance().LoadFile(fileName.c_str(), mFileLoader, decoding);
+    if (sample == nullptr || !IsCurrent(generation))
+    {
+      return result;
+    }
+  }
+  Report(generation, kDecodedProgress);
+
+  // a sample too short to have any frames left at the new rate can't be converted
+  sample = SampleCache::Instance().Convert(sample, sampleRate);
+  if (sample == nullptr || !IsCurrent(generation))
+  {
+    return result;
+  }
+  Report(generation, kConvertedProgress);
+
+  // the table is built once per sample, so a sample that was already cached is ready straight away
+  if (mPrepare != nullptr)
+  {
+    mPrepare(*sample);
+  }
+  if (!IsCurrent(generation))
+  {
+    return result;
+  }
+  Report(generation, kPreparedProgress);
+
+  if (peakCount > 0)
+  {
+    result.peaks.resize(peakCount);
+    ComputePeaks(sample->buffer, result.peaks.data(), peakCount);
+  }
+
+  result.sample = std::move(sample);
+  return result;
+}
+
+void SampleLoader::Report(unsigned generation, float progress)
+{
+  // under the lock, so a load that has just been abandoned can't undo the Cancel
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (IsCurrent(generation))
+  {
+    mProgress = progress;
+  }
+}
+
+void SampleLoader::ComputePeaks(const Minim::MultiChannelBuffer& buffer, float* peaks, int count)
+{
+  const int frames = buffer.getBufferSize();
+  const int chunkSize = frames / count;
+  const bool stereo = buffer.getChannelCount() == 2;
+  for (int i = 0; i < count; ++i)
+  {
+    float peak = 0;
+    int s = 0;
+    for (; s < chunkSize; ++s)
+    {
+      const int frame = i*chunkSize + s;
+      if (frame >= frames)
+      {
+        break;
+      }
+      const float val = stereo ? (buffer.getChannel(0)[frame] + buffer.getChannel(1)[frame]) / 2.f : buffer.getChannel(0)[frame];
+      peak += val*val;
+    }
+    peak /= s + 1;
+    peaks[i] = sqrtf(peak);
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "FileLoader.h"
+#include "SampleCache.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads samples chosen in the UI on a worker thread, so the editor and the host's message loop
+// keep running while a long file decodes.
+//
+// The UI thread asks for a file with Request, which replaces anything asked for before it. A load that
+// is still in flight when a newer one is requested, or when Cancel is called, stops at its next step
+// and whatever it made is thrown away. The worker decodes the file through the SampleCache, converts it
+// to the host's rate, builds the wavetable the DSP will play and measures the peaks drawn in the
+// waveform view, so the UI thread only has to collect the result from Poll and hand the table to the
+// DSP, which picks it up without waiting. Poll and GetProgress never wait on the worker either, they
+// just try again on the next idle call.
+class SampleLoader
+{
+public:
+  // worker thread: builds whatever the DSP will need from a sample before it is handed over
+  typedef void (*Prepare)(const SampleCache::Sample& sample);
+
+  struct Result
+  {
+    // null when the file could not be decoded
+    SampleCache::Handle sample;
+    // the level of each section of the sample, see ComputePeaks. empty when no peaks were asked for.
+    std::vector<float> peaks;
+  };
+
+  // files longer than maxFrames are cut off at that length. prepare may be null.
+  SampleLoader(int maxFrames, Prepare prepare);
+  ~SampleLoader();
+
+  SampleLoader(const SampleLoader&) = delete;
+  SampleLoader& operator=(const SampleLoader&) = delete;
+
+  // UI thread: loads a sample embedded in the plugin right away, without the worker.
+  // must not be called once a file has been requested.
+  SampleCache::Handle LoadResource(int resourceID, const char* resourceName);
+
+  // UI thread: starts loading fileName in the background, converting it to sampleRate and measuring
+  // peakCount peaks of it, and abandons the load that was in flight, if there was one.
+  void Request(const char* fileName, int peakCount, double sampleRate);
+  // UI thread: the same for a sample that has already been loaded, which only needs converting
+  void Request(const SampleCache::Handle& sample, int peakCount, double sampleRate);
+
+  // UI thread: abandons the load that is in flight
+  void Cancel();
+
+  // UI thread: moves a finished load into result and returns true, or returns false if there isn't one yet.
+  // a load that failed shows up here as well, with a null sample. ones that were abandoned never do.
+  bool Poll(Result& result);
+
+  // any thread: how far the load in flight has got, from 0 to 1, or -1 when nothing is loading
+  // and there is no finished load waiting to be collected
+  float GetProgress() const { return mProgress.load(std::memory_order_relaxed); }
+
+  // the root mean square of each of count equal sections of buffer, with its channels mixed together
+  static void ComputePeaks(const Minim::MultiChannelBuffer& buffer, float* peaks, int count);
+
+private:
+  void Run();
+  // UI thread: queues the request set up in the members below, must be called with mMutex held
+  void Queue();
+  // worker thread: loads fileName, or converts sample when fileName is empty. returns an empty
+  // result if the load fails or is superseded before it finishes, which Run tells apart with IsCurrent.
+  Result Load(const std::string& fileName, SampleCache::Handle sample, int peakCount, double sampleRate, unsigned generation);
+  // worker thread: updates the progress if generation is still the load the UI wants
+  void Report(unsigned generation, float progress);
+  // worker thread: true while generation is still the load the UI wants
+  bool IsCurrent(unsigned generation) const { return mGeneration.load() == generation; }
+
+  FileLoader mFileLoader;
+  const Prepare mPrepare;
+
+  // guards everything below it, and is never held while loading
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  // a request is waiting for the worker to pick it up
+  bool mRequested;
+  std::string mRequestedFile;
+  SampleCache::Handle mRequestedSample;
+  int mRequestedPeakCount;
+  double mRequestedRate;
+  bool mHasResult;
+  Result mResult;
+  bool mQuit;
+
+  // bumped by every Request and Cancel, so the worker can tell that its load is no longer wanted
+  std::atomic<unsigned> mGeneration;
+  std::atomic<float> mProgress;
+  // started by the first Request
+  std::thread mThread;
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+// Stereo wavetable lookup used by the block graph's waveshaper.
+// The table is stored interleaved (left, right, left, right, ...) with guard frames on either side
+// that repeat the first and last frame, so each scrub position is mapped to a table index once and
+// both channels are read and interpolated together without any bounds checks.
+// SSE2 and AVX2 versions are used when the compiler targets them, with a scalar fallback
+// that also handles whatever is left over at the end of a block.
+//
+// Each interpolator is written once against the small set of arithmetic helpers below,
+// which are overloaded for plain floats and doubles and for every vector type used,
+// so the scalar and vector lookups always compute exactly the same polynomial.
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SHAPER_KERNEL_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SHAPER_KERNEL_SSE2 1
+#endif
+
+namespace block
+{
+  // frames of padding a table needs before its first frame and after its last
+  // for the widest interpolator to read from anywhere in it
+  const int shaperGuardBefore = 2;
+  const int shaperGuardAfter = 3;
+
+  struct shaperInterpolation
+  {
+    enum type
+    {
+      linear,
+      // 4-point, 3rd order Hermite
+      hermite,
+      // Olli Niemitalo's 6-point, 5th order interpolator optimized for 2x oversampled signals
+      optimal,
+
+      count
+    };
+  };
+
+  namespace kernel
+  {
+    template<typename V> V splat(double value);
+    template<> inline float splat<float>(double value) { return (float)value; }
+    template<> inline double splat<double>(double value) { return value; }
+    inline float add(float a, float b) { return a + b; }
+    inline float sub(float a, float b) { return a - b; }
+    inline float mul(float a, float b) { return a * b; }
+    inline double add(double a, double b) { return a + b; }
+    inline double sub(double a, double b) { return a - b; }
+    inline double mul(double a, double b) { return a * b; }
+
+#if SHAPER_KERNEL_AVX2
+    template<> inline __m256d splat<__m256d>(double value) { return _mm256_set1_pd(value); }
+    template<> inline __m256 splat<__m256>(double value) { return _mm256_set1_ps((float)value); }
+    inline __m256d add(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+    inline __m256d sub(__m256d a, __m256d b) { return _mm256_sub_pd(a, b); }
+    inline __m256d mul(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+    inline __m256 add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    inline __m256 sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+    inline __m256 mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+
+    // table position of four and eight scrub values, split into the whole frame and the fraction past it
+    inline void position(const __m256d in, const __m256d last, __m128i& idx, __m256d& frac)
+    {
+      const __m256d half = _mm256_set1_pd(0.5);
+      __m256d at = _mm256_add_pd(_mm256_mul_pd(in, half), half);
+      at = _mm256_sub_pd(at, _mm256_floor_pd(at));
+      const __m256d pos = _mm256_mul_pd(at, last);
+      idx = _mm256_cvttpd_epi32(pos);
+      frac = _mm256_sub_pd(pos, _mm256_cvtepi32_pd(idx));
+    }
+
+    inline void position(const __m256 in, const __m256 last, __m256i& idx, __m256& frac)
+    {
+      const __m256 half = _mm256_set1_ps(0.5f);
+      __m256 at = _mm256_add_ps(_mm256_mul_ps(in, half), half);
+      at = _mm256_sub_ps(at, _mm256_floor_ps(at));
+      const __m256 pos = _mm256_mul_ps(at, last);
+      idx = _mm256_cvttps_epi32(pos);
+      frac = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(idx));
+    }
+#elif SHAPER_KERNEL_SSE2
+    template<> inline __m128d splat<__m128d>(double value) { return _mm_set1_pd(value); }
+    template<> inline __m128 splat<__m128>(double value) { return _mm_set1_ps((float)value); }
+    inline __m128d add(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+    inline __m128d sub(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+    inline __m128d mul(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+    inline __m128 add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    inline __m128 sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+    inline __m128 mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+
+    // table position of two and four scrub values, split into the whole frame and the fraction past it
+    inline void position(const __m128d in, const __m128d last, __m128i& idx, __m128d& frac)
+    {
+      const __m128d half = _mm_set1_pd(0.5);
+      const __m128d one = _mm_set1_pd(1.0);
+      __m128d at = _mm_add_pd(_mm_mul_pd(in, half), half);
+      // floor without SSE4.1: truncate, then step down wherever truncating rounded up
+      __m128d whole = _mm_cvtepi32_pd(_mm_cvttpd_epi32(at));
+      whole = _mm_sub_pd(whole, _mm_and_pd(_mm_cmpgt_pd(whole, at), one));
+      at = _mm_sub_pd(at, whole);
+      const __m128d pos = _mm_mul_pd(at, last);
+      idx = _mm_cvttpd_epi32(pos);
+      frac = _mm_sub_pd(pos, _mm_cvtepi32_pd(idx));
+    }
+
+    inline void position(const __m128 in, const __m128 last, __m128i& idx, __m128& frac)
+    {
+      const __m128 half = _mm_set1_ps(0.5f);
+      const __m128 one = _mm_set1_ps(1.0f);
+      __m128 at = _mm_add_ps(_mm_mul_ps(in, half), half);
+      __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(at));
+      whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, at), one));
+      at = _mm_sub_ps(at, whole);
+      const __m128 pos = _mm_mul_ps(at, last);
+      idx = _mm_cvttps_epi32(pos);
+      frac = _mm_sub_ps(pos, _mm_cvtepi32_ps(idx));
+    }
+#endif
+
+    // each interpolator reads `points` frames starting `before` frames ahead of the frame the position is in.
+    // y holds those frames for one channel and t is how far past y[before] the position is.
+    struct linear
+    {
+      enum { points = 2, before = 0 };
+
+      template<typename V>
+      static V eval(const V* y, const V t)
+      {
+        return add(y[0], mul(sub(y[1], y[0]), t));
+      }
+    };
+
+    struct hermite
+    {
+      enum { points = 4, before = 1 };
+
+      template<typename V>
+      static V eval(const V* y, const V t)
+      {
+        const V half = splat<V>(0.5);
+        const V c1 = mul(half, sub(y[2], y[0]));
+        const V c2 = sub(add(y[0], mul(splat<V>(2.0), y[2])), add(mul(splat<V>(2.5), y[1]), mul(half, y[3])));
+        const V c3 = add(mul(half, sub(y[3], y[0])), mul(splat<V>(1.5), sub(y[1], y[2])));
+        return add(mul(add(mul(add(mul(c3, t), c2), t), c1), t), y[1]);
+      }
+    };
+
+    // "Polynomial Interpolators for High-Quality Resampling of Oversampled Audio", optimal 2x, 6-point, 5th order, z-form
+    struct optimal
+    {
+      enum { points = 6, before = 2 };
+
+      template<typename V>
+      static V eval(const V* y, const V t)
+      {
+        const V z = sub(t, splat<V>(0.5));
+        const V even1 = add(y[3], y[2]), odd1 = sub(y[3], y[2]);
+        const V even2 = add(y[4], y[1]), odd2 = sub(y[4], y[1]);
+        const V even3 = add(y[5], y[0]), odd3 = sub(y[5], y[0]);
+        const V c0 = add(add(mul(even1, splat<V>(0.40513396007145713)), mul(even2, splat<V>(0.09251794438424393))), mul(even3, splat<V>(0.00234806603570670)));
+        const V c1 = add(add(mul(odd1, splat<V>(0.28342806338906690)), mul(odd2, splat<V>(0.21703277024054901))), mul(odd3, splat<V>(0.01309294748731515)));
+        const V c2 = add(add(mul(even1, splat<V>(-0.191337682540351941)), mul(even2, splat<V>(0.16187844487943592))), mul(even3, splat<V>(0.02946017143111912)));
+        const V c3 = add(add(mul(odd1, splat<V>(-0.16471626190554542)), mul(odd2, splat<V>(-0.00154547203542499))), mul(odd3, splat<V>(0.03399271444851909)));
+        const V c4 = add(add(mul(even1, splat<V>(0.03845798729588149)), mul(even2, splat<V>(-0.05712936104242644))), mul(even3, splat<V>(0.01866750929921070)));
+        const V c5 = add(add(mul(odd1, splat<V>(0.04317950185225609)), mul(odd2, splat<V>(-0.01802814255926417))), mul(odd3, splat<V>(0.00152170021558204)));
+        return add(mul(add(mul(add(mul(add(mul(add(mul(c5, z), c4), z), c3), z), c2), z), c1), z), c0);
+      }
+    };
+  }
+
+  // maps an input in the range [-1, 1] to a position in [0, 1), wrapping values outside of that range.
+  template<typename T>
+  inline T shaperMap(const T in)
+  {
+    const T at = in * (T)0.5 + (T)0.5;
+    return at - std::floor(at);
+  }
+
+  // writes the table value for each scrub position in `in` to outLeft and outRight.
+  // table points at the first of size interleaved stereo frames and is padded with the guard frames.
+  template<typename Interp, typename T>
+  inline void shaperLookupScalar(const T* table, const int size, const T* in, T* outLeft, T* outRight, const int nFrames)
+  {
+    const T last = (T)(size - 1);
+    for (int s = 0; s < nFrames; ++s)
+    {
+      const T pos = shaperMap(in[s]) * last;
+      const int i = (int)pos;
+      const T frac = pos - i;
+      const T* frame = table + (i - Interp::before) * 2;
+      T left[Interp::points], right[Interp::points];
+      for (int k = 0; k < Interp::points; ++k)
+      {
+        left[k] = frame[k * 2];
+        right[k] = frame[k * 2 + 1];
+      }
+      outLeft[s] = Interp::eval(left, frac);
+      outRight[s] = Interp::eval(right, frac);
+    }
+  }
+
+  template<typename Interp, typename T>
+  inline void shaperLookup(const T* table, const int size, const T* in, T* outLeft, T* outRight, const int nFrames)
+  {
+    shaperLookupScalar<Interp>(table, size, in, outLeft, outRight, nFrames);
+  }
+
+  template<typename Interp>
+  inline void shaperLookup(const double* table, const int size, const double* in, double* outLeft, double* outRight, const int nFrames)
+  {
+    int s = 0;
+    const double* first = table - Interp::before * 2;
+#if SHAPER_KERNEL_AVX2
+    const __m256d last = _mm256_set1_pd(size - 1);
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      __m128i idx;
+      __m256d frac;
+      kernel::position(_mm256_loadu_pd(in + s), last, idx, frac);
+      const __m128i offset = _mm_slli_epi32(idx, 1);
+      __m256d left[Interp::points], right[Interp::points];
+      for (int k = 0; k < Interp::points; ++k)
+      {
+        left[k] = _mm256_i32gather_pd(first + k * 2, offset, 8);
+        right[k] = _mm256_i32gather_pd(first + k * 2 + 1, offset, 8);
+      }
+      _mm256_storeu_pd(outLeft + s, Interp::eval(left, frac));
+      _mm256_storeu_pd(outRight + s, Interp::eval(right, frac));
+    }
+#elif SHAPER_KERNEL_SSE2
+    const __m128d last = _mm_set1_pd(size - 1);
+    for (; s + 2 <= nFrames; s += 2)
+    {
+      __m128i idx;
+      __m128d frac;
+      kernel::position(_mm_loadu_pd(in + s), last, idx, frac);
+      const double* frame0 = first + _mm_cvtsi128_si32(idx) * 2;
+      const double* frame1 = first + _mm_cvtsi128_si32(_mm_srli_si128(idx, 4)) * 2;
+      // each load reads the left and right value of a frame together, so both channels are interpolated at once
+      __m128d y0[Interp::points], y1[Interp::points];
+      for (int k = 0; k < Interp::points; ++k)
+      {
+        y0[k] = _mm_loadu_pd(frame0 + k * 2);
+        y1[k] = _mm_loadu_pd(frame1 + k * 2);
+      }
+      const __m128d out0 = Interp::eval(y0, _mm_unpacklo_pd(frac, frac));
+      const __m128d out1 = Interp::eval(y1, _mm_unpackhi_pd(frac, frac));
+      _mm_storeu_pd(outLeft + s, _mm_unpacklo_pd(out0, out1));
+      _mm_storeu_pd(outRight + s, _mm_unpackhi_pd(out0, out1));
+    }
+#endif
+    shaperLookupScalar<Interp>(table, size, in + s, outLeft + s, outRight + s, nFrames - s);
+  }
+
+  template<typename Interp>
+  inline void shaperLookup(const float* table, const int size, const float* in, float* outLeft, float* outRight, const int nFrames)
+  {
+    int s = 0;
+    const float* first = table - Interp::before * 2;
+#if SHAPER_KERNEL_AVX2
+    const __m256 last = _mm256_set1_ps((float)(size - 1));
+    for (; s + 8 <= nFrames; s += 8)
+    {
+      __m256i idx;
+      __m256 frac;
+      kernel::position(_mm256_loadu_ps(in + s), last, idx, frac);
+      const __m256i offset = _mm256_slli_epi32(idx, 1);
+      __m256 left[Interp::points], right[Interp::points];
+      for (int k = 0; k < Interp::points; ++k)
+      {
+        left[k] = _mm256_i32gather_ps(first + k * 2, offset, 4);
+        right[k] = _mm256_i32gather_ps(first + k * 2 + 1, offset, 4);
+      }
+      _mm256_storeu_ps(outLeft + s, Interp::eval(left, frac));
+      _mm256_storeu_ps(outRight + s, Interp::eval(right, frac));
+    }
+#elif SHAPER_KERNEL_SSE2
+    const __m128 last = _mm_set1_ps((float)(size - 1));
+    for (; s + 4 <= nFrames; s += 4)
+    {
+      __m128i idx;
+      __m128 frac;
+      kernel::position(_mm_loadu_ps(in + s), last, idx, frac);
+      alignas(16) int index[4];
+      _mm_store_si128((__m128i*)index, idx);
+
+      // two frames, one for each of a pair of samples, fit in a register as left, right, left, right,
+      // so each pair is interpolated at once and then split back out into the two channels
+      for (int pair = 0; pair < 4; pair += 2)
+      {
+        const float* frame0 = first + index[pair] * 2;
+        const float* frame1 = first + index[pair + 1] * 2;
+        __m128 y[Interp::points];
+        for (int k = 0; k < Interp::points; ++k)
+        {
+          y[k] = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(frame0 + k * 2)), (const __m64*)(frame1 + k * 2));
+        }
+        const __m128 t = pair == 0 ? _mm_unpacklo_ps(frac, frac) : _mm_unpackhi_ps(frac, frac);
+        const __m128 out = Interp::eval(y, t);
+        const __m128 split = _mm_shuffle_ps(out, out, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storel_pi((__m64*)(outLeft + s + pair), split);
+        _mm_storeh_pi((__m64*)(outRight + s + pair), split);
+      }
+    }
+#endif
+    shaperLookupScalar<Interp>(table, size, in + s, outLeft + s, outRight + s, nFrames - s);
+  }
+
+  template<typename T>
+  inline void shaperLookup(const shaperInterpolation::type interpolation, const T* table, const int size, const T* in, T* outLeft, T* outRight, const int nFrames)
+  {
+    switch (interpolation)
+    {
+      case shaperInterpolation::hermite:
+        shaperLookup<kernel::hermite>(table, size, in, outLeft, outRight, nFrames);
+        break;
+
+      case shaperInterpolation::optimal:
+        shaperLookup<kernel::optimal>(table, size, in, outLeft, outRight, nFrames);
+        break;
+
+      default:
+        shaperLookup<kernel::linear>(table, size, in, outLeft, outRight, nFrames);
+        break;
+    }
+  }
+}
@@ -50,8 +50,22 @@ const double kPercentStep = 1;
 const char * kPercentLabel = "%";
 #pragma  endregion
 
+#if IPLUG_DSP
+// runs on the loader's worker, so the DSP never has to build a table itself
+static void PrepareSample(const SampleCache::Sample& sample)
+{
+  sample.GetTable<DSP_PRECISION>();
+}
+#else
+static const SampleLoader::Prepare PrepareSample = nullptr;
+#endif
+
 WaveShaper::WaveShaper(const InstanceInfo& instanceInfo)
 : Plugin(instanceInfo, MakeConfig(kNumParams, kNumPrograms))
+, mSampleLoader(MAX_SAMPLE_FRAMES, PrepareSample)
+, mConversionRate(0)
+, mDeclinedRate(0)
+, mFailedRate(0)
 #if IPLUG_EDITOR
 , mInterface(this)
 #endif
@@ -92,11 +106,28 @@ WaveShaper::WaveShaper(const InstanceInfo& instanceInfo)
     GetParam(kEnvRelease)->InitDouble("Release", kEnvReleaseDefault, kEnvReleaseMin, kEnvReleaseMax, kSecondsStep, kSecondsLabel, IParam::kFlagsNone, "ADSR");
   }
 
-  mBuffer.setBufferSize(BUFFER_SIZE);
-  mFileLoader.Load(SND_01_ID, SND_01_FN, mBuffer);
+  GetParam(kOversampling)->InitEnum("Oversampling", OS_1x, OS_Count);
+  GetParam(kOversampling)->SetDisplayText(OS_1x, "1x");
+  GetParam(kOversampling)->SetDisplayText(OS_2x, "2x");
+  GetParam(kOversampling)->SetDisplayText(OS_4x, "4x");
+  GetParam(kOversampling)->SetDisplayText(OS_8x, "8x");
+
+  GetParam(kInterpolation)->InitEnum("Interpolation", IM_Linear, IM_Count);
+  GetParam(kInterpolation)->SetDisplayText(IM_Linear, "Linear");
+  GetParam(kInterpolation)->SetDisplayText(IM_Hermite, "Hermite");
+  GetParam(kInterpolation)->SetDisplayText(IM_Optimal, "6-Point");
+
+  GetParam(kEnvCurve)->InitEnum("Curve", EC_Linear, EC_Count, "", IParam::kFlagsNone, "ADSR");
+  GetParam(kEnvCurve)->SetDisplayText(EC_Linear, "Linear");
+  GetParam(kEnvCurve)->SetDisplayText(EC_Exponential, "Exponential");
+
+  mSample = mSampleLoader.LoadResource(SND_01_ID, SND_01_FN);
 
 #if IPLUG_DSP
-  mDSP.SetWavetables(mBuffer);
+  if (mSample != nullptr)
+  {
+    mDSP.SetWavetables(mSample);
+  }
 #endif
 
 #if IPLUG_EDITOR // All UI methods and member variables should be within an IPLUG_EDITOR guard, should you want distributed UI
@@ -106,7 +137,10 @@ WaveShaper::WaveShaper(const InstanceInfo& instanceInfo)
   
   mLayoutFunc = [&](IGraphics* pGraphics) {
     mInterface.CreateControls(pGraphics);
-    mInterface.RebuildPeaks(mBuffer);
+    if (mSample != nullptr)
+    {
+      mInterface.RebuildPeaks(mSample->buffer);
+    }
 
 //    pGraphics->AttachCornerResizer(kUIResizerScale, false);
 //    pGraphics->AttachPanelBackground(COLOR_GRAY);
@@ -132,15 +166,11 @@ WaveShaper::WaveShaper(const InstanceInfo& instanceInfo)
 #if IPLUG_DSP
 void WaveShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 {
-  const int nChans = NOutChansConnected();
+  // the release, the noise filters and the smoothers all decay towards zero
+  ScopedFlushDenormals flushDenormals;
 
-  mDSP.ProcessBlock(inputs, outputs, 2, nFrames);
-  
-  for (auto s = 0; s < nFrames; s++) {
-    for (auto c = 0; c < nChans; c++) {
-      outputs[c][s] = outputs[c][s];
-    }
-  }
+  // stereo, mixed down for a mono output or repeated across the pairs of a wider one
+  mDSP.ProcessBlock(inputs, outputs, NOutChansConnected(), nFrames);
 
   mMeterBallistics.ProcessBlock(outputs, nFrames);
 }
@@ -148,11 +178,88 @@ void WaveShaper::ProcessBlock(sample** inputs, sample** outputs, int nFrames)
 void WaveShaper::OnIdle()
 {
   mMeterBallistics.TransmitData(*this);
+
+  // a sample that has been faded out is freed soon after, rather than when the next one is loaded
+  mDSP.FreeUnusedWavetables();
+
+  if (mLatencyChanged.exchange(false))
+  {
+    UpdateLatency();
+  }
+
+  // a file finished loading in the background, everything it needs has already been built
+  SampleLoader::Result loaded;
+  if (mSampleLoader.Poll(loaded))
+  {
+    if (loaded.sample == nullptr)
+    {
+      // the file couldn't be decoded, or the sample couldn't be converted, so the sample that was playing keeps playing
+      if (mConversionRate > 0)
+      {
+        mFailedRate = mConversionRate;
+      }
+#if IPLUG_EDITOR
+      mInterface.ShowLoadFailed();
+#endif
+    }
+    else
+    {
+      mSample = loaded.sample;
+
+      // the DSP queues the cached wavetable and swaps over to it, with a short crossfade,
+      // at the start of its next block.
+      mDSP.SetWavetables(mSample);
+
+#if IPLUG_EDITOR
+      if (!loaded.peaks.empty())
+      {
+        mInterface.SetPeaks(loaded.peaks);
+      }
+      else
+      {
+        mInterface.RebuildPeaks(mSample->buffer);
+      }
+#endif
+    }
+    mConversionRate = 0;
+  }
+
+  // samples are played at the host's rate. OnReset can run on the audio thread, so a change of rate
+  // is noticed here instead, and the sample is converted in the background once nothing else is loading.
+  // a conversion to a rate that the user cancelled, or that failed, is left alone until they load something else.
+  const double sampleRate = GetSampleRate();
+  if (mSample != nullptr && mSample->sampleRate > 0 && mSample->sampleRate != sampleRate && sampleRate != mDeclinedRate
+      && sampleRate != mFailedRate && mSampleLoader.GetProgress() < 0)
+  {
+    mConversionRate = sampleRate;
+#if IPLUG_EDITOR
+    mSampleLoader.Request(mSample, mInterface.GetPeaksSize(), sampleRate);
+#else
+    mSampleLoader.Request(mSample, 0, sampleRate);
+#endif
+  }
+
+#if IPLUG_EDITOR
+  mInterface.SetLoadProgress(mSampleLoader.GetProgress());
+#endif
 }
 
 void WaveShaper::OnReset()
 {
   mDSP.Reset(GetSampleRate(), GetBlockSize());
+
+  // this can be running on the audio thread as well, and the tail depends on the sample rate
+  mLatencyChanged = true;
+}
+
+void WaveShaper::UpdateLatency()
+{
+  // the up and down sampling filters delay the output
+  SetLatency(mDSP.GetLatency());
+
+  // once the input stops, the longest release and the oversampling filters are all
+  // that can still be heard, after which the DSP only writes silence
+  SetTailSize((int)(kEnvReleaseMax * GetSampleRate()) + mDSP.GetLatency());
 }
 
 void WaveShaper::ProcessMidiMsg(const IMidiMsg& msg)
@@ -254,6 +361,27 @@ void WaveShaper::OnParamChange(int paramIdx)
     }
     break;
 
+    case kOversampling:
+    {
+      mDSP.SetOversampling(1 << param->Int());
+      // the host is told about the new latency from OnIdle, this can be running on the audio thread
+      mLatencyChanged = true;
+    }
+    break;
+
+    case kInterpolation:
+      switch (param->Int())
+      {
+        case IM_Linear:  mDSP.SetInterpolation(block::shaperInterpolation::linear);  break;
+        case IM_Hermite: mDSP.SetInterpolation(block::shaperInterpolation::hermite); break;
+        case IM_Optimal: mDSP.SetInterpolation(block::shaperInterpolation::optimal); break;
+      }
+      break;
+
+    case kEnvCurve:
+      mDSP.SetEnvelopeCurve(param->Int() == EC_Exponential ? Envelope::kExponential : Envelope::kLinear);
+      break;
+
     default:
       break;
   }
@@ -355,12 +483,33 @@ void WaveShaper::HandleLoad(WDL_String* fileName, WDL_String* directory)
   }
   else
   {
-    // we can load without locking cause mBuffer is not used by the DSP chain,
-    // so it's better to hang the UI thread than the audio thread.
-    mFileLoader.Load(fileName->Get(), mBuffer);
-    mInterface.RebuildPeaks(mBuffer);
+    // the file is decoded in the background and picked up in OnIdle once it is ready, replacing any load
+    // that is still in flight. a sample that is already in the cache, from this instance or any other,
+    // is not decoded again.
+    mSampleLoader.Request(fileName->Get(), mInterface.GetPeaksSize(), GetSampleRate());
+    mConversionRate = 0;
+    mDeclinedRate = 0;
+    mFailedRate = 0;
+  }
+}
 
-    mDSP.SetWavetables(mBuffer);
+#if IPLUG_EDITOR
+void WaveShaper::OnUIClose()
+{
+  // the peaks are rebuilt from mSample by the layout function when the editor is opened again
+  mInterface.OnClose();
+}
+#endif
+
+void WaveShaper::CancelLoad()
+{
+  mSampleLoader.Cancel();
+
+  // OnIdle would otherwise start the same conversion again straight away
+  if (mConversionRate > 0)
+  {
+    mDeclinedRate = mConversionRate;
+    mConversionRate = 0;
   }
 }
 
@@ -6,11 +6,14 @@
 
 #include "Interface.h"
 #include "Controls.h"
-#include "FileLoader.h"
-#include "MultiChannelBuffer.h"
+#include "SampleCache.h"
+#include "SampleLoader.h"
 
 #if IPLUG_DSP
 #include "DSP.h"
+#include "Denormals.h"
+
+#include <atomic>
 #endif
 
 using namespace iplug;
@@ -27,6 +30,11 @@ public:
   void HandleSave(WDL_String* fileName, WDL_String* directory);
   void HandleLoad(WDL_String* fileName, WDL_String* directory);
   void HandleAction(BangControl::Action action);
+#if IPLUG_EDITOR
+  void OnUIClose() override;
+#endif
+  // abandons the audio file being loaded in the background, if there is one
+  void CancelLoad();
   void DumpPresetSrc();
 
   // getters used by UI classes to draw things
@@ -58,8 +66,16 @@ public:
   NoiseSnapshot GetNoiseSnapshotNormalized(int idx);
 
 private:
-  FileLoader mFileLoader;
-  Minim::MultiChannelBuffer mBuffer;
+  // decodes audio files chosen in the UI in the background, see OnIdle
+  SampleLoader mSampleLoader;
+  // shared with every other instance that has loaded the same sample, null until one has loaded
+  SampleCache::Handle mSample;
+  // the host rate mSample is being converted to in the background, or 0 when it isn't
+  double mConversionRate;
+  // the rate of a conversion that was cancelled, which isn't asked for again until another sample is loaded
+  double mDeclinedRate;
+  // the same for a conversion that failed, which would only fail again
+  double mFailedRate;
 
   NoiseSnapshot mNoiseSnapshots[kNoiseSnapshotCount];
 
@@ -73,8 +89,15 @@ public:
 
   void SetParamBlend(int paramIdx, double begin, double end, double blend);
 private:
-  WaveShaperDSP mDSP {2};
+  // tells the host how late the output is and how long it keeps going after the input stops
+  void UpdateLatency();
+
+  WaveShaperDSP<DSP_PRECISION> mDSP {2};
   IVMeterControl<1>::Sender mMeterBallistics {kCtrlTagMeter};
+  // set by OnReset and when the oversampling changes, both of which can happen on the audio thread,
+  // so that OnIdle tells the host about the new latency and tail from the main thread.
+  // starts out set so the host hears about them once the plugin is up.
+  std::atomic<bool> mLatencyChanged {true};
 #endif
 
 #if IPLUG_EDITOR
@@ -0,0 +1,209 @@
+#include "WavetableStore.h"
+#include "Oversampler.h"
+#include "ShaperKernel.h"
+#include "Denormals.h"
+
+#include <algorithm>
+
+// levels are not made any shorter than this
+static const int kMinLevelSize = 32;
+
+// copies the first and last frame of a level into the guard frames either side of it
+template<typename T>
+static void FillGuards(T* level, const int size)
+{
+  for (int i = 1; i <= block::shaperGuardBefore; ++i)
+  {
+    level[-i * 2] = level[0];
+    level[-i * 2 + 1] = level[1];
+  }
+  for (int i = 0; i < block::shaperGuardAfter; ++i)
+  {
+    level[(size + i) * 2] = level[(size - 1) * 2];
+    level[(size + i) * 2 + 1] = level[(size - 1) * 2 + 1];
+  }
+}
+
+// how many levels a sample of size frames gets, and how many frames they take up altogether including their guard frames
+static int CountLevels(const int size, int& totalFrames)
+{
+  int levels = 0;
+  totalFrames = 0;
+  for (int levelSize = size; levels < WavetableStore<float>::Table::kMaxLevels; levelSize = (levelSize + 1) / 2)
+  {
+    totalFrames += block::shaperGuardBefore + levelSize + block::shaperGuardAfter;
+    ++levels;
+    if (levelSize < kMinLevelSize * 2)
+    {
+      break;
+    }
+  }
+  return levels;
+}
+
+template<typename T>
+WavetableStore<T>::Table::Table()
+  : size(0)
+  , data(nullptr)
+  , levels(0)
+{
+}
+
+template<typename T>
+WavetableStore<T>::Table::~Table()
+{
+  delete[] data;
+}
+
+template<typename T>
+void WavetableStore<T>::Table::Build(const float* left, const float* right, int size)
+{
+  // the filters that build the levels run into the quiet ends of samples
+  ScopedFlushDenormals flushDenormals;
+
+  int totalFrames = 0;
+  const int count = CountLevels(size, totalFrames);
+  delete[] data;
+  data = new T[totalFrames * 2];
+
+  T* next = data;
+  for (int i = 0, frames = size; i < count; ++i, frames = (frames + 1) / 2)
+  {
+    level[i] = next + block::shaperGuardBefore * 2;
+    levelSize[i] = frames;
+    next += (block::shaperGuardBefore + frames + block::shaperGuardAfter) * 2;
+  }
+  this->size = size;
+  levels = size > 0 ? count : 0;
+
+  T* frames = level[0];
+  for (int i = 0; i < size; ++i)
+  {
+    frames[i * 2] = left[i];
+    frames[i * 2 + 1] = right[i];
+  }
+
+  if (levels > 0)
+  {
+    FillGuards(level[0], levelSize[0]);
+  }
+
+  // a half-band lowpass removes everything that would alias once every other frame is dropped.
+  // the whole sample is available, so the filter is centered on each frame it keeps rather than delayed.
+  const int K = 8;
+  const T* c = block::halfbandCoefficients<T, K>();
+
+  for (int l = 1; l < levels; ++l)
+  {
+    const T* in = level[l - 1];
+    const int inSize = levelSize[l - 1];
+    T* out = level[l];
+    const int outSize = levelSize[l];
+
+    for (int i = 0; i < outSize; ++i)
+    {
+      // a level has (inSize + 1) / 2 frames, so every one of them is centered on a frame of the level above
+      const int center = i * 2;
+      for (int ch = 0; ch < 2; ++ch)
+      {
+        T sum = in[center * 2 + ch] * (T)0.5;
+        for (int j = 0; j < K; ++j)
+        {
+          // frames past either end are taken to repeat the first or last one
+          const int after = std::min(center + j * 2 + 1, inSize - 1);
+          const int before = std::max(center - j * 2 - 1, 0);
+          sum += c[j] * (in[after * 2 + ch] + in[before * 2 + ch]);
+        }
+        out[i * 2 + ch] = sum;
+      }
+    }
+
+    FillGuards(out, outSize);
+  }
+}
+
+template<typename T>
+WavetableStore<T>::WavetableStore()
+  : mPending(kNone)
+  , mCurrent(kNone)
+  , mPrevious(kNone)
+{
+  for (int i = 0; i < kTableCount; ++i)
+  {
+    mState[i].store(kFree);
+  }
+}
+
+template<typename T>
+void WavetableStore<T>::Load(std::shared_ptr<const Table> table)
+{
+  // take back a table the audio thread hasn't picked up yet, otherwise find a slot nobody is using
+  int idx = mPending.exchange(kNone, std::memory_order_acquire);
+  if (idx == kNone)
+  {
+    for (idx = 0; idx < kTableCount; ++idx)
+    {
+      int expected = kFree;
+      if (mState[idx].compare_exchange_strong(expected, kLoading, std::memory_order_acquire))
+      {
+        break;
+      }
+    }
+  }
+  mState[idx].store(kLoading, std::memory_order_relaxed);
+
+  // nothing else can be reading this slot, so whatever table it held can be let go of here
+  mTables[idx] = std::move(table);
+
+  mState[idx].store(kPending, std::memory_order_relaxed);
+  mPending.store(idx, std::memory_order_release);
+
+  FreeUnused();
+}
+
+template<typename T>
+void WavetableStore<T>::FreeUnused()
+{
+  for (int i = 0; i < kTableCount; ++i)
+  {
+    int expected = kFree;
+    if (mTables[i] != nullptr && mState[i].compare_exchange_strong(expected, kLoading, std::memory_order_acquire))
+    {
+      mTables[i].reset();
+      mState[i].store(kFree, std::memory_order_release);
+    }
+  }
+}
+
+template<typename T>
+bool WavetableStore<T>::Update()
+{
+  if (mPrevious != kNone || mPending.load(std::memory_order_relaxed) == kNone)
+  {
+    return false;
+  }
+
+  const int idx = mPending.exchange(kNone, std::memory_order_acquire);
+  if (idx == kNone)
+  {
+    return false;
+  }
+
+  mState[idx].store(kLive, std::memory_order_relaxed);
+  mPrevious = mCurrent;
+  mCurrent = idx;
+  return true;
+}
+
+template<typename T>
+void WavetableStore<T>::ReleasePrevious()
+{
+  if (mPrevious != kNone)
+  {
+    mState[mPrevious].store(kFree, std::memory_order_release);
+    mPrevious = kNone;
+  }
+}
+
+template class WavetableStore<float>;
+template class WavetableStore<double>;
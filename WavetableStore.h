@@ -0,0 +1,104 @@
+#pragma once
+
+#include "IPlugStructs.h"
+
+#include <atomic>
+#include <memory>
+
+using namespace iplug;
+
+// Wavetables shared between the UI thread, which loads new samples into them,
+// and the audio thread, which renders from them.
+//
+// Tables are built once and never written to again, so any number of stores, in any number of
+// plugin instances, can play from the same one. A store holds a reference to each table it has been
+// given, which the UI thread only lets go of once the audio thread has given the table back, so a
+// table is never freed on the audio thread or while it is being read. The UI thread checks for tables
+// that have been given back in FreeUnused.
+//
+// A new table is handed over through an atomic index that the audio thread picks up at a block
+// boundary, so neither thread ever waits on the other. The audio thread keeps the table it was
+// using until it has faded it out and then gives it back. There are enough slots that the UI thread
+// always finds one to put a table in: the audio thread holds at most two, and a table that is still
+// waiting to be picked up is simply taken back and replaced. Load must only be called from one thread.
+//
+// Building a table also builds a pyramid of band-limited copies of the sample, each one low-passed and
+// decimated from the one before it, so that scrubbing faster than one frame per output frame
+// can read from a level that has nothing in it to alias. The levels live in the same allocation
+// as the sample and add up to about as much again.
+//
+// Tables hold frames at the precision T the block engine renders at. Only float and double
+// are instantiated, in WavetableStore.cpp.
+template<typename T>
+class WavetableStore
+{
+public:
+  struct Table
+  {
+    enum { kMaxLevels = 16 };
+
+    Table();
+    ~Table();
+
+    Table(const Table&) = delete;
+    Table& operator=(const Table&) = delete;
+
+    // copies the channels into data, which is allocated to fit them, and fills in every level
+    void Build(const float* left, const float* right, int size);
+
+    // number of frames in the sample, not counting guard frames
+    int size;
+    // every level, one after the other
+    T* data;
+
+    // level 0 is the sample itself and each level after it is half as long. each points at the first of
+    // its interleaved stereo frames, which are padded with guard frames, see ShaperKernel.h.
+    // levels is 0 when nothing has been loaded.
+    int levels;
+    int levelSize[kMaxLevels];
+    T* level[kMaxLevels];
+  };
+
+  WavetableStore();
+
+  // UI thread: queues a table that has already been built for the audio thread.
+  void Load(std::shared_ptr<const Table> table);
+
+  // UI thread: lets go of every table the audio thread has given back, and with it the cached sample
+  // it was built from. called on every Load, and should be called regularly in between as well.
+  void FreeUnused();
+
+  // audio thread: picks up a newly loaded table, returning true when the current table changed.
+  // nothing is picked up while the previous table is still held.
+  bool Update();
+
+  // audio thread: gives the previous table back once it is no longer being read.
+  void ReleasePrevious();
+
+  // audio thread: the table to render from and the one being replaced, either may be null.
+  const Table* GetCurrent() const { return mCurrent == kNone ? nullptr : mTables[mCurrent].get(); }
+  const Table* GetPrevious() const { return mPrevious == kNone ? nullptr : mTables[mPrevious].get(); }
+
+private:
+  enum
+  {
+    kNone = -1,
+    kTableCount = 3,
+  };
+
+  enum EState
+  {
+    kFree,
+    kLoading,
+    kPending,
+    kLive,
+  };
+
+  std::shared_ptr<const Table> mTables[kTableCount];
+  std::atomic<int> mState[kTableCount];
+  std::atomic<int> mPending;
+
+  // only touched by the audio thread
+  int mCurrent;
+  int mPrevious;
+};
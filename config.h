@@ -13,7 +13,7 @@
 #define BUNDLE_MFR "compartmental"
 #define BUNDLE_DOMAIN "net"
 
-#define PLUG_CHANNEL_IO "0-2"
+#define PLUG_CHANNEL_IO "0-1 0-2"
 
 #define PLUG_LATENCY 0
 #define PLUG_TYPE 1
@@ -51,5 +51,11 @@
 #define ROBOTO_FN "Roboto-Regular.ttf"
 #define FONTAUDIO_FN "fontaudio.ttf"
 
+// longest sample, in frames, that will be loaded into the wavetables. longer files are cut off.
+#ifndef MAX_SAMPLE_FRAMES
+#define MAX_SAMPLE_FRAMES (48000 * 60)
+#endif
+
+// the default sample is compiled into FileLoader.cpp, see scripts/embed_sample.py
 #define SND_01_ID 101
 #define SND_01_FN "resources/snd/BadBassAmp.wav"
@@ -0,0 +1,27 @@
+#!/usr/bin/python
+
+# this script turns an audio file into the bytes of a C array initializer, which FileLoader.cpp includes
+# so that the default sample is built into the plugin the same way on every platform.
+# run it again whenever the sample changes, e.g.
+#   python scripts/embed_sample.py resources/snd/BadBassAmp.wav resources/snd/BadBassAmp.wav.inc
+
+import os, sys
+
+def main():
+  if len(sys.argv) != 3:
+    print("usage: embed_sample.py <audio file> <output file>")
+    sys.exit(1)
+
+  src, dst = sys.argv[1], sys.argv[2]
+  with open(src, "rb") as f:
+    data = bytearray(f.read())
+
+  with open(dst, "w") as out:
+    out.write("// Generated by scripts/embed_sample.py from " + os.path.basename(src) + ", " + str(len(data)) + " bytes. Do not edit.\n")
+    for i in range(0, len(data), 16):
+      out.write(",".join("0x%02x" % b for b in data[i:i + 16]) + ",\n")
+
+  print("wrote " + str(len(data)) + " bytes of " + src + " to " + dst)
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,202 @@
+// Renders a fixed sequence through the Minim graph and the block graph and checks that the block graph
+// still nulls against the Minim one, path by path.
+//
+// WaveShaperDSP is built with DSP_ENGINE_NULLTEST, which ticks both graphs and compares them frame by frame
+// as it goes, see NullTest in DSP.cpp. The sequence below plays notes legato and released, moves every
+// parameter and plays the noise with each tint, all at fixed times. The block graph seeds its voices the
+// same way every time and rand() is seeded here for the Minim side, so every run renders the same thing.
+// Each path is checked against DSP_NULLTEST_TOLERANCE. The noise comes from a different generator in each
+// graph, so its level is checked against kNoiseLevelTolerance instead. The program prints every path and
+// whether it diverged, and exits with 1 if any of them did.
+
+#include "DSP.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+// the plugin's defaults, which WaveShaperDSP starts from, are defined alongside its parameters in WaveShaper.cpp
+extern const double kDefaultMod = 0.5;
+extern const double kDefaultRate = 0.0005;
+extern const double kDefaultRange = 0;
+extern const double kDefaultShape = 0.1;
+extern const double kEnvAttackMin = 0.005;
+extern const double kEnvDecayMin = 0.005;
+extern const double kEnvSustainDefault = 75;
+extern const double kEnvReleaseDefault = 0.25;
+
+namespace
+{
+  typedef WaveShaperDSP<DSP_PRECISION> DSP;
+  typedef DSP::NullTestReport Report;
+
+  const double kSampleRate = 44100;
+  // not a multiple of DSP_BLOCK_SIZE, so the block graph renders partial blocks as well
+  const int kBlockSize = 441;
+  const unsigned kSeed = 0x5EED;
+  // the level of two runs of the same noise from different seeds differs by up to about 10% over a few seconds
+  const double kNoiseLevelTolerance = 0.2;
+
+  struct Event
+  {
+    enum Kind
+    {
+      kNoteOn,
+      kNoteOff,
+      kRate,
+      kMod,
+      kRange,
+      kShape,
+      kVolume,
+      kTint,
+      kCurve
+    };
+
+    double time;
+    Kind kind;
+    // the note number for notes, otherwise what the parameter is set to
+    double value;
+    int velocity;
+  };
+
+  const Event kSequence[] =
+  {
+    { 0.00, Event::kNoteOn, 60, 100 },
+    // legato, the envelope carries on from the first note
+    { 0.05, Event::kNoteOn, 64, 80 },
+    { 0.30, Event::kNoteOff, 60, 0 },
+    { 0.50, Event::kMod, 4, 0 },
+    { 0.80, Event::kRange, 0.3, 0 },
+    { 1.00, Event::kShape, 0.3, 0 },
+    { 1.20, Event::kRate, 0.001, 0 },
+    { 1.50, Event::kNoteOff, 64, 0 },
+    { 2.00, Event::kCurve, Envelope::kExponential, 0 },
+    { 2.10, Event::kNoteOn, 67, 127 },
+    // from here the noise moves on every frame, so that there is enough of each tint to measure its level
+    { 2.50, Event::kRate, 1, 0 },
+    { 6.00, Event::kTint, Minim::Noise::eTintWhite, 0 },
+    { 9.50, Event::kTint, Minim::Noise::eTintBrown, 0 },
+    { 12.0, Event::kVolume, 0.5, 0 },
+    { 13.0, Event::kNoteOff, 67, 0 },
+  };
+  // long enough for the last release to finish
+  const double kLength = 14;
+
+  // one cycle of a sine on the left and of a rounded saw on the right, so that both shapers have something to look up
+  SampleCache::Handle MakeSample()
+  {
+    const int size = 2048;
+    const double pi = 3.14159265358979323846;
+    std::shared_ptr<SampleCache::Sample> sample = std::make_shared<SampleCache::Sample>();
+    sample->buffer.setChannelCount(2);
+    sample->buffer.setBufferSize(size);
+    float* left = sample->buffer.getChannel(0);
+    float* right = sample->buffer.getChannel(1);
+    for (int i = 0; i < size; ++i)
+    {
+      const double phase = 2 * pi * i / size;
+      left[i] = (float)std::sin(phase);
+      right[i] = (float)(std::sin(phase) - std::sin(2 * phase) / 2 + std::sin(3 * phase) / 3);
+    }
+    sample->hash = 0;
+    sample->sampleRate = kSampleRate;
+    return sample;
+  }
+
+  // notes go in at their frame within the block, parameters are set before the block like a host's automation
+  void Apply(DSP& dsp, const Event& event, int offset)
+  {
+    IMidiMsg msg;
+    switch (event.kind)
+    {
+      case Event::kNoteOn:
+        msg.MakeNoteOnMsg((int)event.value, event.velocity, offset);
+        dsp.ProcessMidiMsg(msg);
+        break;
+      case Event::kNoteOff:
+        msg.MakeNoteOffMsg((int)event.value, offset);
+        dsp.ProcessMidiMsg(msg);
+        break;
+      case Event::kRate: dsp.SetNoiseRate(event.value); break;
+      case Event::kMod: dsp.SetNoiseMod(event.value); break;
+      case Event::kRange: dsp.SetNoiseRange(event.value); break;
+      case Event::kShape: dsp.SetNoiseShape(event.value); break;
+      case Event::kVolume: dsp.SetVolume(event.value); break;
+      case Event::kTint: dsp.SetNoiseTint((Minim::Noise::Tint)(int)event.value); break;
+      case Event::kCurve: dsp.SetEnvelopeCurve((Envelope::Curve)(int)event.value); break;
+    }
+  }
+
+  // prints every path and returns false if any of them diverged
+  bool Check(const Report& report)
+  {
+    bool passed = true;
+    printf("%-9s %12s  %s\n", "path", "difference", "");
+    for (int path = 0; path < Report::kPathCount; ++path)
+    {
+      const double error = report.maxError[path];
+      const bool diverged = error > DSP_NULLTEST_TOLERANCE;
+      printf("%-9s %12.3g  ", Report::PathName(path), error);
+      if (diverged)
+      {
+        printf("DIVERGED, first by this much at %.4fs\n", report.maxErrorFrame[path] / kSampleRate);
+      }
+      else
+      {
+        printf("ok\n");
+      }
+      passed = passed && !diverged;
+    }
+
+    const char* tints[] = { "white", "pink", "brown" };
+    printf("\n%-9s %12s %12s\n", "noise", "Minim rms", "block rms");
+    for (int tint = 0; tint < 3; ++tint)
+    {
+      printf("%-9s ", tints[tint]);
+      if (report.noiseFrames[tint] == 0)
+      {
+        printf("%12s %12s  NOT PLAYED\n", "-", "-");
+        passed = false;
+        continue;
+      }
+
+      const double minim = std::sqrt(report.minimNoise[tint] / report.noiseFrames[tint]);
+      const double block = std::sqrt(report.blockNoise[tint] / report.noiseFrames[tint]);
+      const bool diverged = !(std::abs(block - minim) <= minim * kNoiseLevelTolerance);
+      printf("%12.4f %12.4f  %s\n", minim, block, diverged ? "DIVERGED" : "ok");
+      passed = passed && !diverged;
+    }
+
+    printf("\n%s\n", passed ? "block graph nulls against the Minim graph" : "block graph DIVERGES from the Minim graph");
+    return passed;
+  }
+}
+
+int main()
+{
+  std::srand(kSeed);
+
+  DSP dsp(2);
+  dsp.Reset(kSampleRate, kBlockSize);
+  dsp.SetWavetables(MakeSample());
+
+  std::vector<sample> left(kBlockSize), right(kBlockSize);
+  sample* outputs[2] = { left.data(), right.data() };
+
+  const int events = sizeof(kSequence) / sizeof(kSequence[0]);
+  const int length = (int)(kLength * kSampleRate);
+  int next = 0;
+  for (int frame = 0; frame < length; frame += kBlockSize)
+  {
+    while (next < events && (int)(kSequence[next].time * kSampleRate) < frame + kBlockSize)
+    {
+      Apply(dsp, kSequence[next], (int)(kSequence[next].time * kSampleRate) - frame);
+      ++next;
+    }
+    dsp.ProcessBlock(nullptr, outputs, 2, kBlockSize);
+  }
+
+  return Check(dsp.GetNullTestReport()) ? 0 : 1;
+}
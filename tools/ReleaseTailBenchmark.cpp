@@ -0,0 +1,140 @@
+// Times the tail of a note on its way to silence, with and without denormals flushed to zero.
+//
+// Each voice is white noise scaled by an exponential release and run through the pink or red
+// noise filter, the same units the block graph builds its voices from. Once the release has
+// finished the filters are only fed zeros, and their feedback takes their state down through
+// the denormal range, where a one-pole this close to 1 rounds back onto the same denormal
+// value forever instead of reaching zero. That is the case ScopedFlushDenormals is there for.
+//
+// Build with the Makefile next to this file and run it with optimizations on. It prints how long
+// both renders took and how many of the samples each one wrote were denormal.
+
+#include "BlockDSP.h"
+#include "Denormals.h"
+#include "Envelope.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+  const float kSampleRate = 44100;
+  const int kBlockSize = 64;
+  const int kVoices = 8;
+  // how long each note is held before it is released
+  const float kHold = 0.1f;
+  const float kRelease = 0.5f;
+  // the release, plus the tail after it where the filters are decaying with nothing going in
+  const float kTail = 5;
+  // every render is repeated and the fastest is kept, to keep other work on the machine out of it
+  const int kRuns = 5;
+
+  struct Voice
+  {
+    Envelope envelope;
+    block::whiteNoise white;
+    block::pinkFilter<float> pink;
+    block::redFilter<float> red;
+  };
+
+  struct Result
+  {
+    double seconds;
+    long denormals;
+  };
+
+  bool IsDenormal(float x)
+  {
+    return x != 0 && std::fabs(x) < 1.17549435e-38f;
+  }
+
+  // renders kVoices notes with the given tint from note on to the end of the tail
+  Result Render(block::noiseTint::type tint, bool flushDenormals)
+  {
+    std::vector<Voice> voices(kVoices);
+    for (int v = 0; v < kVoices; ++v)
+    {
+      voices[v].white.seed(0x9E3779B9u + v * 0x6C8E9CF5u);
+      voices[v].envelope.setSampleRate(kSampleRate);
+      voices[v].envelope.setCurve(Envelope::kExponential);
+      voices[v].envelope.noteOn(1, 0.005f, 0.05f, 0.75f, kRelease);
+    }
+
+    const int holdBlocks = (int)(kHold * kSampleRate / kBlockSize);
+    const int blocks = holdBlocks + (int)(kTail * kSampleRate / kBlockSize);
+    float noise[kBlockSize];
+    float env[kBlockSize];
+    Result result = { 0, 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+      ScopedFlushDenormals flush(flushDenormals);
+      for (int b = 0; b < blocks; ++b)
+      {
+        for (Voice& voice : voices)
+        {
+          if (b == holdBlocks)
+          {
+            voice.envelope.noteOff();
+          }
+
+          voice.white.render(noise, kBlockSize);
+          voice.envelope.render(env, kBlockSize);
+          for (int s = 0; s < kBlockSize; ++s)
+          {
+            noise[s] *= env[s];
+          }
+
+          if (tint == block::noiseTint::pink)
+          {
+            voice.pink.render(noise, kBlockSize);
+          }
+          else
+          {
+            voice.red.render(noise, kBlockSize);
+          }
+
+          // counting every sample would swamp what is being timed, the last one of each block is enough to see it happen
+          result.denormals += IsDenormal(noise[kBlockSize - 1]) ? kBlockSize : 0;
+        }
+      }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+  }
+
+  Result Fastest(block::noiseTint::type tint, bool flushDenormals)
+  {
+    Result best = Render(tint, flushDenormals);
+    for (int r = 1; r < kRuns; ++r)
+    {
+      const Result result = Render(tint, flushDenormals);
+      if (result.seconds < best.seconds)
+      {
+        best = result;
+      }
+    }
+    return best;
+  }
+}
+
+int main()
+{
+  const double rendered = kVoices * (kHold + kTail);
+  printf("%d voices, %.1fs release tail each, %.0f seconds of voice in total\n\n", kVoices, kTail, rendered);
+
+  const block::noiseTint::type tints[] = { block::noiseTint::pink, block::noiseTint::red };
+  const char* names[] = { "pink", "red" };
+  for (int t = 0; t < 2; ++t)
+  {
+    const Result normal = Fastest(tints[t], false);
+    const Result flushed = Fastest(tints[t], true);
+    printf("%-4s  with denormals %8.2fms  (~%ld denormal samples)\n", names[t], normal.seconds * 1000, normal.denormals);
+    printf("%-4s  flushed        %8.2fms  (~%ld denormal samples)  %.1fx faster\n\n", names[t], flushed.seconds * 1000, flushed.denormals,
+           normal.seconds / flushed.seconds);
+  }
+
+  return 0;
+}